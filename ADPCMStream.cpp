@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "ADPCMStream.h"
+#include "ThreadPool.h"
+
+// ----------------------------------------------------------------------------
+static const int s_stepSizes[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767
+};
+
+// Step index changes by code magnitude, for 2 to 5 bit codes
+static const int s_indexChanges2[] = { -1, 2 };
+static const int s_indexChanges3[] = { -1, -1, 2, 4 };
+static const int s_indexChanges4[] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+static const int s_indexChanges5[] = { -1, -1, -1, -1, -1, -1, -1, -1, 1, 2, 4, 6, 8, 10, 13, 16 };
+static const int* const s_indexChanges[4] = { s_indexChanges2, s_indexChanges3, s_indexChanges4, s_indexChanges5 };
+
+// ----------------------------------------------------------------------------
+// Predictor of one channel, kept in step with what the player decodes
+struct ChannelState
+{
+	int predictor;
+	int stepIndex;
+};
+
+// ----------------------------------------------------------------------------
+static int encodeSample(ChannelState& state, int sample, unsigned int codeBits, const int* indexChanges)
+{
+	int signBit = 1 << (codeBits - 1);
+	int step = s_stepSizes[state.stepIndex];
+	int diff = sample - state.predictor;
+	int code = 0;
+	if (diff < 0)
+	{
+		code = signBit;
+		diff = -diff;
+	}
+
+	// Successive approximation with halving steps, the difference the player
+	// rebuilds from the code is summed up alongside
+	int delta = 0;
+	for (int bit = signBit >> 1; bit != 0; bit >>= 1)
+	{
+		if (diff >= step)
+		{
+			code |= bit;
+			diff -= step;
+			delta += step;
+		}
+		step >>= 1;
+	}
+	delta += step;
+
+	state.predictor += (code & signBit) ? -delta : delta;
+	state.predictor = std::max(-32768, std::min(32767, state.predictor));
+	state.stepIndex = std::max(0, std::min(88, state.stepIndex + indexChanges[code & (signBit - 1)]));
+	return code;
+}
+
+// ----------------------------------------------------------------------------
+ADPCMStream::ADPCMStream() :
+	m_samples(NULL),
+	m_sampleCount(0),
+	m_sampleRate(0),
+	m_channels(0),
+	m_codeBits(4),
+	m_nextBlock(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool ADPCMStream::setSamples(const short* samples, unsigned long sampleCount, unsigned int sampleRate,
+							 unsigned int channels, unsigned int codeBits)
+{
+	if (samples == NULL || sampleCount == 0 || (channels != 1 && channels != 2) || codeBits < 2 || codeBits > 5)
+		return false;
+
+	m_samples = samples;
+	m_sampleCount = sampleCount;
+	m_sampleRate = sampleRate;
+	m_channels = channels;
+	m_codeBits = codeBits;
+	m_blocks.clear();
+	m_nextBlock = 0;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void ADPCMStream::encodeBlock(unsigned long first, unsigned long count, BitWriter& bits) const
+{
+	const int* indexChanges = s_indexChanges[m_codeBits - 2];
+	const short* samples = m_samples + first * m_channels;
+
+	bits.reset();
+	bits.writeBits(m_codeBits - 2, 2);
+	for (unsigned long packet = 0; packet < count; packet += PACKET_SAMPLES)
+	{
+		// A packet opens with the exact first sample and a step index sized
+		// to the first difference, so a block does not depend on the one before
+		unsigned long packetSize = std::min<unsigned long>(PACKET_SAMPLES, count - packet);
+		const short* packetSamples = samples + packet * m_channels;
+		ChannelState states[2];
+		for (unsigned int c = 0; c < m_channels; ++c)
+		{
+			int delta = packetSize > 1 ? abs(packetSamples[m_channels + c] - packetSamples[c]) : 0;
+			ChannelState& state = states[c];
+			state.predictor = packetSamples[c];
+			// The packet header only has room for indexes up to 63
+			state.stepIndex = std::min<int>(std::lower_bound(s_stepSizes, s_stepSizes + 88, delta) - s_stepSizes, 63);
+			bits.writeBits(state.predictor, 16);
+			bits.writeBits(state.stepIndex, 6);
+		}
+
+		for (unsigned long i = 1; i < packetSize; ++i)
+		{
+			for (unsigned int c = 0; c < m_channels; ++c)
+			{
+				bits.writeBits(encodeSample(states[c], packetSamples[i * m_channels + c], m_codeBits, indexChanges), m_codeBits);
+			}
+		}
+	}
+	bits.finish();
+}
+
+// ----------------------------------------------------------------------------
+bool ADPCMStream::encode(unsigned int frameRate, ThreadPool* pool)
+{
+	if (m_samples == NULL || frameRate == 0)
+		return false;
+
+	// SWF frame n plays samples n * rate / fps up to the start of the next,
+	// the rate is scaled to match the 8.8 frame rate
+	unsigned long long rate = static_cast<unsigned long long>(m_sampleRate) << 8;
+	unsigned long blockCount = static_cast<unsigned long>((m_sampleCount * static_cast<unsigned long long>(frameRate) + rate - 1) / rate);
+	m_blocks.resize(blockCount);
+	m_nextBlock = 0;
+
+	// Ranges of blocks per task, each block writes to its own BitWriter
+	const unsigned long blocksPerTask = 32;
+	TaskGroup group(blockCount > blocksPerTask ? pool : NULL);
+	for (unsigned long firstBlock = 0; firstBlock < blockCount; firstBlock += blocksPerTask)
+	{
+		unsigned long lastBlock = std::min(blockCount, firstBlock + blocksPerTask);
+		group.run([this, firstBlock, lastBlock, rate, frameRate]()
+		{
+			for (unsigned long n = firstBlock; n < lastBlock; ++n)
+			{
+				unsigned long first = static_cast<unsigned long>(n * rate / frameRate);
+				unsigned long last = static_cast<unsigned long>(std::min<unsigned long long>(m_sampleCount, (n + 1) * rate / frameRate));
+				encodeBlock(first, last - first, m_blocks[n]);
+			}
+		});
+	}
+	group.wait();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void ADPCMStream::rewind()
+{
+	m_nextBlock = 0;
+}
+
+// ----------------------------------------------------------------------------
+const BitWriter* ADPCMStream::nextBlock()
+{
+	return isFinished() ? NULL : &m_blocks[m_nextBlock++];
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include "BitWriter.h"
+
+class ThreadPool;
+
+// ----------------------------------------------------------------------------
+// 16-bit PCM encoded to SWF ADPCM SoundStreamBlocks, one per SWF frame. Every
+// block starts its own ADPCM packets, so the blocks are encoded independently
+// on the thread pool.
+class ADPCMStream
+{
+public:
+	enum { PACKET_SAMPLES = 4096 };
+
+private:
+	const short* m_samples;			// Interleaved, not owned
+	unsigned long m_sampleCount;	// Per channel
+	unsigned int m_sampleRate;
+	unsigned int m_channels;
+	unsigned int m_codeBits;
+	std::vector<BitWriter> m_blocks;
+	unsigned long m_nextBlock;
+
+private:
+	void encodeBlock(unsigned long first, unsigned long count, BitWriter& bits) const;
+
+public:
+	ADPCMStream();
+
+	// The samples have to stay valid until encode() returns. 2 to 5 bits per code.
+	bool setSamples(const short* samples, unsigned long sampleCount, unsigned int sampleRate,
+					unsigned int channels, unsigned int codeBits = 4);
+	bool encode(unsigned int frameRate, ThreadPool* pool);	// 8.8 fixed point frame rate
+	void rewind();
+
+	inline unsigned int getSampleRate() const { return m_sampleRate; }
+	inline unsigned int getChannels() const { return m_channels; }
+	inline unsigned int getCodeBits() const { return m_codeBits; }
+	inline unsigned long getSampleCount() const { return m_sampleCount; }
+	inline unsigned long getBlockCount() const { return m_blocks.size(); }
+	inline bool isFinished() const { return m_nextBlock >= m_blocks.size(); }
+
+	// Next encoded block, NULL once the stream is exhausted
+	const BitWriter* nextBlock();
+};
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <vector>
+#include "AssetIndex.h"
+#include "MappedFile.h"
+#include "Hash.h"
+
+// ----------------------------------------------------------------------------
+// On-disk layout, little-endian:
+//   'S' 'W' 'A' 'I', UI32 version, UI32 entry count, then for every entry
+//   UI32 path length, UI32 characters of the path, UI64 size, SI64 time, UI64 hash
+static const unsigned int INDEX_VERSION = 1;
+
+// ----------------------------------------------------------------------------
+static void appendLong(std::vector<unsigned char>& buffer, unsigned long long value, unsigned int size)
+{
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		buffer.push_back(static_cast<unsigned char>(value >> (i * 8)));
+	}
+}
+
+// ----------------------------------------------------------------------------
+static bool readLong(const unsigned char*& p, const unsigned char* end, unsigned long long& value, unsigned int size)
+{
+	if (static_cast<unsigned long>(end - p) < size)
+		return false;
+
+	value = 0;
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		value |= static_cast<unsigned long long>(*p++) << (i * 8);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+AssetIndex::AssetIndex()
+{
+}
+
+// ----------------------------------------------------------------------------
+AssetIndex::~AssetIndex()
+{
+}
+
+// ----------------------------------------------------------------------------
+bool AssetIndex::find(const std::wstring& filename, unsigned long long& hash, unsigned long& size) const
+{
+	// Only costs a stat of the file
+	unsigned long fileSize;
+	long long modifiedTime;
+	if (!MappedFile::getFileInfo(filename, fileSize, modifiedTime))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	EntryMap::const_iterator i = m_entries.find(filename);
+	if (i == m_entries.end() || i->second.size != fileSize || i->second.modifiedTime != modifiedTime)
+		return false;
+
+	hash = i->second.hash;
+	size = fileSize;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+unsigned long long AssetIndex::insert(const std::wstring& filename, const MappedFile& file)
+{
+	unsigned long long hash = hashXXH64(file.getData(), file.getSize());
+
+	// A file that changed since it was opened is not recorded
+	Entry entry;
+	entry.hash = hash;
+	if (MappedFile::getFileInfo(filename, entry.size, entry.modifiedTime) && entry.size == file.getSize())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[filename] = entry;
+	}
+
+	return hash;
+}
+
+// ----------------------------------------------------------------------------
+void AssetIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+// ----------------------------------------------------------------------------
+bool AssetIndex::load(const std::wstring& indexFile)
+{
+	MappedFile file;
+	if (!file.open(indexFile))
+		return false;
+
+	const unsigned char* p = file.getData();
+	const unsigned char* end = p + file.getSize();
+	unsigned long long version, count;
+	if (file.getSize() < 4 || p[0] != 'S' || p[1] != 'W' || p[2] != 'A' || p[3] != 'I')
+		return false;
+	p += 4;
+	if (!readLong(p, end, version, 4) || version != INDEX_VERSION || !readLong(p, end, count, 4))
+		return false;
+
+	EntryMap entries;
+	for (unsigned long long n = 0; n < count; ++n)
+	{
+		unsigned long long length, size, modifiedTime, hash;
+		if (!readLong(p, end, length, 4) || static_cast<unsigned long long>(end - p) < length * 4)
+			return false;
+
+		std::wstring filename(static_cast<size_t>(length), L'\0');
+		for (std::wstring::iterator i = filename.begin(); i != filename.end(); ++i)
+		{
+			unsigned long long c = 0;
+			readLong(p, end, c, 4);
+			*i = static_cast<wchar_t>(c);
+		}
+
+		if (!readLong(p, end, size, 8) || !readLong(p, end, modifiedTime, 8) || !readLong(p, end, hash, 8))
+			return false;
+
+		Entry& entry = entries[filename];
+		entry.size = static_cast<unsigned long>(size);
+		entry.modifiedTime = static_cast<long long>(modifiedTime);
+		entry.hash = hash;
+	}
+
+	// Entries recorded during this run take precedence
+	std::lock_guard<std::mutex> lock(m_mutex);
+	entries.swap(m_entries);
+	for (EntryMap::const_iterator i = entries.begin(); i != entries.end(); ++i)
+	{
+		m_entries[i->first] = i->second;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool AssetIndex::save(const std::wstring& indexFile) const
+{
+	std::vector<unsigned char> buffer;
+	buffer.push_back('S');
+	buffer.push_back('W');
+	buffer.push_back('A');
+	buffer.push_back('I');
+	appendLong(buffer, INDEX_VERSION, 4);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		appendLong(buffer, m_entries.size(), 4);
+		for (EntryMap::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+		{
+			appendLong(buffer, i->first.length(), 4);
+			for (std::wstring::const_iterator c = i->first.begin(); c != i->first.end(); ++c)
+			{
+				appendLong(buffer, static_cast<unsigned int>(*c), 4);
+			}
+			appendLong(buffer, i->second.size, 8);
+			appendLong(buffer, static_cast<unsigned long long>(i->second.modifiedTime), 8);
+			appendLong(buffer, i->second.hash, 8);
+		}
+	}
+
+	FILE* fp = MappedFile::openFile(indexFile, "wb");
+	if (fp == NULL)
+		return false;
+
+	bool success = fwrite(&buffer[0], 1, buffer.size(), fp) == buffer.size();
+	fclose(fp);
+	return success;
+}
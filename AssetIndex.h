@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+
+class MappedFile;
+
+// ----------------------------------------------------------------------------
+// Content hashes of asset files, keyed by path and valid as long as the file
+// keeps its size and modification time. Can be saved and loaded again so that
+// unchanged files are not read just to be hashed on the next run. Safe to
+// share between writers on different threads.
+class AssetIndex
+{
+private:
+	struct Entry
+	{
+		unsigned long size;
+		long long modifiedTime;
+		unsigned long long hash;
+
+		Entry() : size(0), modifiedTime(0), hash(0) {}
+	};
+	typedef std::map<std::wstring, Entry> EntryMap;
+
+private:
+	EntryMap m_entries;
+	mutable std::mutex m_mutex;
+
+private:
+	AssetIndex(const AssetIndex&);
+	AssetIndex& operator=(const AssetIndex&);
+
+public:
+	AssetIndex();
+	~AssetIndex();
+
+	bool find(const std::wstring& filename, unsigned long long& hash, unsigned long& size) const;
+	unsigned long long insert(const std::wstring& filename, const MappedFile& file);
+	void clear();
+
+	bool load(const std::wstring& indexFile);
+	bool save(const std::wstring& indexFile) const;
+};
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include "BatchEngine.h"
+
+// ----------------------------------------------------------------------------
+BatchEngine::BatchEngine(unsigned int threadCount) :
+	m_pool(threadCount),
+	m_group(&m_pool),
+	m_started(false)
+{
+	m_freeWriters.resize(m_pool.getThreadCount());
+}
+
+// ----------------------------------------------------------------------------
+BatchEngine::~BatchEngine()
+{
+	wait();
+}
+
+// ----------------------------------------------------------------------------
+std::unique_ptr<SwfWriter> BatchEngine::acquireWriter(int workerIndex)
+{
+	// A job started while another one waits on the same worker takes a
+	// writer of its own, the list only holds idle ones
+	WriterList* list = &m_sharedWriters;
+	std::unique_lock<std::mutex> lock(m_sharedMutex, std::defer_lock);
+	if (workerIndex >= 0)
+	{
+		list = &m_freeWriters[workerIndex];
+	}
+	else
+	{
+		lock.lock();
+	}
+
+	if (!list->empty())
+	{
+		std::unique_ptr<SwfWriter> writer(std::move(list->back()));
+		list->pop_back();
+		return writer;
+	}
+
+	std::unique_ptr<SwfWriter> writer(new SwfWriter());
+	writer->setReuse(true);
+	writer->setThreadPool(&m_pool);
+	return writer;
+}
+
+// ----------------------------------------------------------------------------
+void BatchEngine::releaseWriter(int workerIndex, std::unique_ptr<SwfWriter> writer)
+{
+	if (workerIndex >= 0)
+	{
+		m_freeWriters[workerIndex].push_back(std::move(writer));
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_sharedMutex);
+		m_sharedWriters.push_back(std::move(writer));
+	}
+}
+
+// ----------------------------------------------------------------------------
+void BatchEngine::runJob(const Job& job, Clock::time_point submitTime)
+{
+	int workerIndex = m_pool.getWorkerIndex();
+	std::unique_ptr<SwfWriter> writer = acquireWriter(workerIndex);
+	job(*writer);
+	releaseWriter(workerIndex, std::move(writer));
+
+	Clock::time_point now = Clock::now();
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_latencies.push_back(std::chrono::duration<double>(now - submitTime).count());
+	m_end = std::max(m_end, now);
+}
+
+// ----------------------------------------------------------------------------
+void BatchEngine::submit(const Job& job)
+{
+	Clock::time_point now = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		if (!m_started)
+		{
+			m_start = now;
+			m_end = now;
+			m_started = true;
+		}
+	}
+
+	m_group.run([this, job, now]()
+	{
+		runJob(job, now);
+	});
+}
+
+// ----------------------------------------------------------------------------
+void BatchEngine::wait()
+{
+	m_group.wait();
+}
+
+// ----------------------------------------------------------------------------
+BatchEngine::Stats BatchEngine::getStats()
+{
+	std::vector<double> latencies;
+	Stats stats;
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		latencies = m_latencies;
+		stats.wallTime = std::chrono::duration<double>(m_end - m_start).count();
+	}
+
+	stats.jobCount = latencies.size();
+	if (latencies.empty())
+		return stats;
+
+	std::sort(latencies.begin(), latencies.end());
+	double total = 0;
+	for (std::vector<double>::const_iterator i = latencies.begin(); i != latencies.end(); ++i)
+	{
+		total += *i;
+	}
+
+	unsigned long last = latencies.size() - 1;
+	stats.meanLatency = total / latencies.size();
+	stats.maxLatency = latencies[last];
+	stats.latency50 = latencies[last * 50 / 100];
+	stats.latency90 = latencies[last * 90 / 100];
+	stats.latency99 = latencies[last * 99 / 100];
+	if (stats.wallTime > 0)
+	{
+		stats.jobsPerSecond = stats.jobCount / stats.wallTime;
+	}
+	return stats;
+}
+
+// ----------------------------------------------------------------------------
+void BatchEngine::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_latencies.clear();
+	m_started = false;
+}
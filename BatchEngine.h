@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "ThreadPool.h"
+#include "SwfWriter.h"
+
+// ----------------------------------------------------------------------------
+// Runs many independent SWF jobs on a work-stealing pool. Each job gets a
+// writer in reuse mode that is recycled on the same worker, and the writers
+// compress on the same pool, so the deflate blocks of one file are stolen by
+// workers that run out of jobs.
+class BatchEngine
+{
+public:
+	// Opens, writes and closes one file. Settings made on the writer stay with
+	// it for the next job it runs.
+	typedef std::function<void(SwfWriter&)> Job;
+
+	struct Stats
+	{
+		unsigned long jobCount;
+		double wallTime;			// Seconds from the first submit to the last completion
+		double jobsPerSecond;
+		double meanLatency;			// Seconds from submit to completion
+		double maxLatency;
+		double latency50;
+		double latency90;
+		double latency99;
+
+		Stats() : jobCount(0), wallTime(0), jobsPerSecond(0), meanLatency(0), maxLatency(0), latency50(0), latency90(0), latency99(0) {}
+	};
+
+private:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::vector<std::unique_ptr<SwfWriter> > WriterList;
+
+private:
+	ThreadPool m_pool;
+	TaskGroup m_group;
+
+	std::vector<WriterList> m_freeWriters;		// One per worker, only touched by that worker
+	WriterList m_sharedWriters;					// For jobs run outside of the workers
+	std::mutex m_sharedMutex;
+
+	std::mutex m_statsMutex;
+	std::vector<double> m_latencies;
+	Clock::time_point m_start;
+	Clock::time_point m_end;
+	bool m_started;
+
+private:
+	BatchEngine(const BatchEngine&);
+	BatchEngine& operator=(const BatchEngine&);
+
+	std::unique_ptr<SwfWriter> acquireWriter(int workerIndex);
+	void releaseWriter(int workerIndex, std::unique_ptr<SwfWriter> writer);
+	void runJob(const Job& job, Clock::time_point submitTime);
+
+public:
+	explicit BatchEngine(unsigned int threadCount = 0);	// 0 => one per hardware thread
+	~BatchEngine();
+
+	inline ThreadPool& getThreadPool() { return m_pool; }
+
+	void submit(const Job& job);
+	void wait();
+
+	Stats getStats();
+	void resetStats();
+};
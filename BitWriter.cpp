@@ -0,0 +1,49 @@
+#include "BitWriter.h"
+
+// ----------------------------------------------------------------------------
+BitWriter::BitWriter() :
+	m_acc(0),
+	m_bitCount(0),
+	m_bytes(256),
+	m_size(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+void BitWriter::grow()
+{
+	m_bytes.resize(m_bytes.size() * 2);
+}
+
+// ----------------------------------------------------------------------------
+void BitWriter::finish()
+{
+	// Move the pending bits out, the last byte padded with zeros
+	while (m_bitCount > 0)
+	{
+		if (m_size + 1 > m_bytes.size())
+		{
+			grow();
+		}
+
+		if (m_bitCount >= 8)
+		{
+			m_bitCount -= 8;
+			m_bytes[m_size++] = static_cast<unsigned char>(m_acc >> m_bitCount);
+		}
+		else
+		{
+			m_bytes[m_size++] = static_cast<unsigned char>(m_acc << (8 - m_bitCount));
+			m_bitCount = 0;
+		}
+	}
+	m_acc = 0;
+}
+
+// ----------------------------------------------------------------------------
+void BitWriter::reset()
+{
+	m_acc = 0;
+	m_bitCount = 0;
+	m_size = 0;
+}
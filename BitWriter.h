@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+// Packs the MSB-first bit fields of SWF records (RECT, MATRIX, shape records...).
+// Bits collect in a 64-bit accumulator and leave it 32 at a time, into a byte
+// region that is reserved ahead and reused from one record to the next.
+class BitWriter
+{
+private:
+	unsigned long long m_acc;	// Pending bits are the low m_bitCount bits
+	unsigned int m_bitCount;
+	std::vector<unsigned char> m_bytes;
+	unsigned long m_size;
+
+private:
+	void grow();
+
+public:
+	BitWriter();
+
+	// Count bits needed to represent an unsigned value.
+	// In practice we're detecting the position of the leftmost bit set to 1.
+	static inline unsigned int countRequiredBits(unsigned int value)
+	{
+		if (value == 0)
+			return 0;
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return index + 1;
+#else
+		return 32 - __builtin_clz(value);
+#endif
+	}
+
+	inline void writeBits(int value, unsigned int numBits)
+	{
+		// numBits is at most 32, so the accumulator never overflows
+		m_acc = (m_acc << numBits) | (static_cast<unsigned int>(value) & ((1ULL << numBits) - 1));
+		m_bitCount += numBits;
+		if (m_bitCount >= 32)
+		{
+			if (m_size + 4 > m_bytes.size())
+			{
+				grow();
+			}
+
+			m_bitCount -= 32;
+			unsigned int word = static_cast<unsigned int>(m_acc >> m_bitCount);
+			unsigned char* dst = &m_bytes[m_size];
+			dst[0] = static_cast<unsigned char>(word >> 24);
+			dst[1] = static_cast<unsigned char>(word >> 16);
+			dst[2] = static_cast<unsigned char>(word >> 8);
+			dst[3] = static_cast<unsigned char>(word);
+			m_size += 4;
+		}
+	}
+
+	inline bool isEmpty() const { return m_size == 0 && m_bitCount == 0; }
+
+	void finish();
+	inline const unsigned char* getData() const { return &m_bytes[0]; }
+	inline unsigned long getSize() const { return m_size; }
+	void reset();
+};
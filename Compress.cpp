@@ -1,25 +1,767 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <algorithm>
 #include "zlib.h"
+#ifdef SWF_USE_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+#ifdef SWF_USE_LZMA
+#include "lzma.h"
+#endif
 #include "Compress.h"
+#include "ThreadPool.h"
+
+// ----------------------------------------------------------------------------
+// Deflate window, the amount of history each parallel block is primed with
+static const unsigned int BLOCK_DICTIONARY_SIZE = 32 * 1024;
+
+// ----------------------------------------------------------------------------
+// zlib allocators counting the allocations in the counter passed as opaque
+static voidpf countedAlloc(voidpf opaque, uInt items, uInt size)
+{
+	++*static_cast<std::atomic<unsigned long>*>(opaque);
+	return malloc(static_cast<size_t>(items) * size);
+}
+
+// ----------------------------------------------------------------------------
+static void countedFree(voidpf /*opaque*/, voidpf address)
+{
+	free(address);
+}
+
+// ----------------------------------------------------------------------------
+static z_stream* newStream(std::atomic<unsigned long>* allocationCount)
+{
+	++*allocationCount;
+	z_stream* stream = new z_stream;
+	stream->zalloc = countedAlloc;
+	stream->zfree = countedFree;
+	stream->opaque = allocationCount;
+	return stream;
+}
+
+// ----------------------------------------------------------------------------
+static void deleteStream(z_stream* stream)
+{
+	deflateEnd(stream);
+	delete stream;
+}
 
 // ----------------------------------------------------------------------------
 ZLIBCompressor::ZLIBCompressor() : 
-	m_quality(ZLIB_DEFAULT_COMPRESSION)
+	m_quality(ZLIB_DEFAULT_COMPRESSION),
+	m_threadPool(NULL),
+	m_blockSize(DEFAULT_BLOCK_SIZE),
+	m_stream(NULL),
+	m_allocationCount(0)
+{
+
+}
+
+// ----------------------------------------------------------------------------
+ZLIBCompressor::~ZLIBCompressor()
+{
+	releaseState();
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBCompressor::releaseState()
+{
+	// Gives back the memory kept for the next call
+	if (m_stream)
+	{
+		deleteStream(m_stream);
+		m_stream = NULL;
+	}
+
+	std::lock_guard<std::mutex> lock(m_blockStreamMutex);
+	for (std::vector<z_stream*>::iterator i = m_blockStreams.begin(); i != m_blockStreams.end(); ++i)
+	{
+		deleteStream(*i);
+	}
+	m_blockStreams.clear();
+	std::vector<Block>().swap(m_blocks);
+}
+
+// ----------------------------------------------------------------------------
+z_stream* ZLIBCompressor::resetStream()
+{
+	// zlib framed stream for the serial path, set up once at the current level
+	if (m_stream == NULL)
+	{
+		m_stream = newStream(&m_allocationCount);
+		if (deflateInit(m_stream, m_quality) != Z_OK)
+		{
+			delete m_stream;
+			m_stream = NULL;
+		}
+	}
+	else if (deflateReset(m_stream) != Z_OK || deflateParams(m_stream, m_quality, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		deleteStream(m_stream);
+		m_stream = NULL;
+	}
+
+	return m_stream;
+}
+
+// ----------------------------------------------------------------------------
+z_stream* ZLIBCompressor::acquireBlockStream(int level)
 {
+	// Called from the pool threads
+	z_stream* stream = NULL;
+	{
+		std::lock_guard<std::mutex> lock(m_blockStreamMutex);
+		if (!m_blockStreams.empty())
+		{
+			stream = m_blockStreams.back();
+			m_blockStreams.pop_back();
+		}
+	}
 
+	if (stream == NULL)
+	{
+		stream = newStream(&m_allocationCount);
+		if (deflateInit2(stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			delete stream;
+			return NULL;
+		}
+	}
+	else if (deflateReset(stream) != Z_OK || deflateParams(stream, level, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		deleteStream(stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBCompressor::releaseBlockStream(z_stream* stream)
+{
+	std::lock_guard<std::mutex> lock(m_blockStreamMutex);
+	m_blockStreams.push_back(stream);
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBCompressor::setThreadPool(ThreadPool* pool, unsigned int blockSize)
+{
+	m_threadPool = pool;
+	m_blockSize = std::max<unsigned int>(blockSize, BLOCK_DICTIONARY_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+ZLIBCompressor::CompressionLevel ZLIBCompressor::getTierLevel(Tier tier)
+{
+	switch (tier)
+	{
+	case TIER_STORE:	return ZLIB_NO_COMPRESSION;
+	case TIER_FAST:		return ZLIB_BEST_SPEED;
+	case TIER_BALANCED:	return ZLIB_MEDIUM_COMPRESSION;
+	default:			return ZLIB_BEST_COMPRESSION;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBCompressor::setTier(Tier tier)
+{
+	m_quality = getTierLevel(tier);
+}
+
+// ----------------------------------------------------------------------------
+unsigned int Compressor::compress(const DataSpanList& input, std::vector<unsigned char>& outBuf)
+{
+	if (input.size() == 1)
+	{
+		return compress(input[0].data, input[0].size, outBuf);
+	}
+
+	std::vector<unsigned char> gathered;
+	for (DataSpanList::const_iterator i = input.begin(); i != input.end(); ++i)
+	{
+		gathered.insert(gathered.end(), i->data, i->data + i->size);
+	}
+	return compress(gathered.empty() ? NULL : &gathered[0], gathered.size(), outBuf);
+}
+
+// ----------------------------------------------------------------------------
+namespace
+{
+	// Runs deflate until it stops producing output, growing outBuf as needed.
+	// outSize is the number of bytes of outBuf in use.
+	int deflateGrow(z_stream& stream, int flush, std::vector<unsigned char>& outBuf, unsigned long& outSize)
+	{
+		int result = Z_OK;
+		do
+		{
+			if (outBuf.size() - outSize < 64)
+			{
+				outBuf.resize(outBuf.size() + outBuf.size() / 2 + 1024);
+			}
+			stream.next_out = &outBuf[outSize];
+			stream.avail_out = outBuf.size() - outSize;
+			result = deflate(&stream, flush);
+			outSize = outBuf.size() - stream.avail_out;
+		} while (result == Z_OK && (stream.avail_in > 0 || stream.avail_out == 0 || flush == Z_FINISH));
+
+		return result;
+	}
+
+	// Deflates the concatenation of the spans into outBuf. For stored spans the
+	// level drops to 0, so already compressed payloads are copied into stored
+	// blocks instead of being searched for matches.
+	bool deflateSpans(z_stream& stream, const DataSpan* spans, unsigned int spanCount, unsigned long size, int level, int flush, std::vector<unsigned char>& outBuf)
+	{
+		unsigned long outSize = 0;
+		outBuf.resize(deflateBound(&stream, size) + 16);
+
+		for (const DataSpan* i = spans; i != spans + spanCount; ++i)
+		{
+			// Changing the level finishes the current block, which may need output space
+			int result = Z_OK;
+			do
+			{
+				if (outBuf.size() - outSize < 64)
+				{
+					outBuf.resize(outBuf.size() + outBuf.size() / 2 + 1024);
+				}
+				stream.next_out = &outBuf[outSize];
+				stream.avail_out = outBuf.size() - outSize;
+				result = deflateParams(&stream, i->stored ? Z_NO_COMPRESSION : level, Z_DEFAULT_STRATEGY);
+				outSize = outBuf.size() - stream.avail_out;
+			} while (result == Z_BUF_ERROR);
+
+			stream.next_in = const_cast<unsigned char*>(i->data);
+			stream.avail_in = i->size;
+			if (result != Z_OK || deflateGrow(stream, Z_NO_FLUSH, outBuf, outSize) != Z_OK)
+				return false;
+		}
+
+		int result = deflateGrow(stream, flush, outBuf, outSize);
+		outBuf.resize(outSize);
+		return result == (flush == Z_FINISH ? Z_STREAM_END : Z_OK);
+	}
+
+	// Collects the spans covering [begin, end) of the concatenated input
+	void sliceSpans(const DataSpanList& spans, unsigned long begin, unsigned long end, DataSpanList& slice)
+	{
+		unsigned long pos = 0;
+		for (DataSpanList::const_iterator i = spans.begin(); i != spans.end() && pos < end; ++i)
+		{
+			unsigned long spanEnd = pos + i->size;
+			if (spanEnd > begin)
+			{
+				unsigned long first = std::max(pos, begin);
+				unsigned long last = std::min(spanEnd, end);
+				slice.push_back(DataSpan(i->data + (first - pos), last - first, i->stored));
+			}
+			pos = spanEnd;
+		}
+	}
 }
 
 // ----------------------------------------------------------------------------
 unsigned int ZLIBCompressor::compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf)
 {
-	unsigned long cSize = getMaxCompressionSize(dSize);
-	
-	outBuf.clear();
-	outBuf.resize(cSize);	// throws on error
-	if (compress2(&outBuf[0], &cSize, dBuffer, dSize, m_quality) != Z_OK)
+	if (m_threadPool && m_threadPool->getThreadCount() > 1 && dSize > m_blockSize)
+	{
+		DataSpanList input(1, DataSpan(dBuffer, dSize));
+		return compressBlocks(input, dSize, outBuf);
+	}
+
+	z_stream* stream = resetStream();
+	DataSpan span(dBuffer, dSize);
+	if (stream == NULL || !deflateSpans(*stream, &span, 1, dSize, m_quality, Z_FINISH, outBuf))
 	{
 		// @todo throw some error here...
+		outBuf.clear();
 	}
-	outBuf.resize(cSize);
+
+	return outBuf.size();
+}
+
+// ----------------------------------------------------------------------------
+unsigned int ZLIBCompressor::compress(const DataSpanList& input, std::vector<unsigned char>& outBuf)
+{
+	unsigned long dSize = 0;
+	for (DataSpanList::const_iterator i = input.begin(); i != input.end(); ++i)
+	{
+		dSize += i->size;
+	}
+
+	if (m_threadPool && m_threadPool->getThreadCount() > 1 && dSize > m_blockSize)
+	{
+		return compressBlocks(input, dSize, outBuf);
+	}
+
+	if (input.size() == 1 && !input[0].stored)
+	{
+		return compress(input[0].data, input[0].size, outBuf);
+	}
+
+	z_stream* stream = resetStream();
+	if (stream == NULL || input.empty() || !deflateSpans(*stream, &input[0], input.size(), dSize, m_quality, Z_FINISH, outBuf))
+	{
+		// @todo throw some error here...
+		outBuf.clear();
+	}
+
+	return outBuf.size();
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBCompressor::deflateBlock(const DataSpanList* input, unsigned long begin, unsigned long end, bool last, int level, Block& block)
+{
+	// Deflates one block as a self-contained piece of a larger raw deflate stream.
+	// The previous 32K of input is used as dictionary so block boundaries barely
+	// cost any ratio, and every block but the last ends on a byte aligned sync
+	// flush so the pieces can simply be concatenated.
+	block.failed = true;
+
+	block.spans.clear();
+	sliceSpans(*input, begin, end, block.spans);
+	block.adler = adler32(0, Z_NULL, 0);
+	for (DataSpanList::const_iterator i = block.spans.begin(); i != block.spans.end(); ++i)
+	{
+		block.adler = adler32(block.adler, i->data, i->size);
+	}
+
+	z_stream* stream = acquireBlockStream(level);
+	if (stream == NULL)
+		return;
+
+	if (begin > 0)
+	{
+		DataSpanList dictSpans;
+		sliceSpans(*input, begin - std::min<unsigned long>(begin, BLOCK_DICTIONARY_SIZE), begin, dictSpans);
+		if (dictSpans.size() == 1)
+		{
+			deflateSetDictionary(stream, dictSpans[0].data, dictSpans[0].size);
+		}
+		else
+		{
+			block.dictionary.clear();
+			for (DataSpanList::const_iterator i = dictSpans.begin(); i != dictSpans.end(); ++i)
+			{
+				block.dictionary.insert(block.dictionary.end(), i->data, i->data + i->size);
+			}
+			deflateSetDictionary(stream, &block.dictionary[0], block.dictionary.size());
+		}
+	}
+
+	block.failed = block.spans.empty() || !deflateSpans(*stream, &block.spans[0], block.spans.size(), end - begin, level, last ? Z_FINISH : Z_SYNC_FLUSH, block.data);
+	releaseBlockStream(stream);
+}
+
+// ----------------------------------------------------------------------------
+unsigned int ZLIBCompressor::compressBlocks(const DataSpanList& input, unsigned long dSize, std::vector<unsigned char>& outBuf)
+{
+	// pigz style: the output only depends on the block size, not on the thread
+	// count or on the order the blocks finish in.
+	unsigned int blockCount = (dSize + m_blockSize - 1) / m_blockSize;
+	std::vector<Block>& blocks = m_blocks;
+	if (blocks.size() < blockCount)
+	{
+		blocks.resize(blockCount);
+	}
+
+	{
+		TaskGroup group(m_threadPool);
+		for (unsigned int i = 0; i < blockCount; ++i)
+		{
+			unsigned long begin = static_cast<unsigned long>(i) * m_blockSize;
+			unsigned long end = std::min(begin + m_blockSize, dSize);
+			bool last = (i == blockCount - 1);
+			int level = m_quality;
+			const DataSpanList* spans = &input;
+			Block* block = &blocks[i];
+			group.run([=]() { deflateBlock(spans, begin, end, last, level, *block); });
+		}
+		group.wait();
+	}
+
+	unsigned long cSize = 2 + 4;
+	unsigned long adler = adler32(0, Z_NULL, 0);
+	for (unsigned int i = 0; i < blockCount; ++i)
+	{
+		if (blocks[i].failed)
+		{
+			// @todo throw some error here...
+			outBuf.clear();
+			return 0;
+		}
+		unsigned long begin = static_cast<unsigned long>(i) * m_blockSize;
+		unsigned long end = std::min(begin + m_blockSize, dSize);
+		adler = adler32_combine(adler, blocks[i].adler, end - begin);
+		cSize += blocks[i].data.size();
+	}
+
+	outBuf.clear();
+	outBuf.reserve(cSize);
+	outBuf.push_back(0x78);
+	outBuf.push_back(0xda);
+	for (unsigned int i = 0; i < blockCount; ++i)
+	{
+		outBuf.insert(outBuf.end(), blocks[i].data.begin(), blocks[i].data.end());
+	}
+	outBuf.push_back(static_cast<unsigned char>(adler >> 24));
+	outBuf.push_back(static_cast<unsigned char>(adler >> 16));
+	outBuf.push_back(static_cast<unsigned char>(adler >> 8));
+	outBuf.push_back(static_cast<unsigned char>(adler));
 
 	return cSize;
-}
\ No newline at end of file
+}
+
+#ifdef SWF_USE_LIBDEFLATE
+// ----------------------------------------------------------------------------
+LibDeflateCompressor::LibDeflateCompressor() :
+	m_level(12),
+	m_compressor(NULL)
+{
+}
+
+// ----------------------------------------------------------------------------
+LibDeflateCompressor::~LibDeflateCompressor()
+{
+	libdeflate_free_compressor(m_compressor);
+}
+
+// ----------------------------------------------------------------------------
+void LibDeflateCompressor::setTier(Tier tier)
+{
+	static const int levels[] = { 0, 1, 6, 12 };
+	if (levels[tier] != m_level)
+	{
+		m_level = levels[tier];
+		libdeflate_free_compressor(m_compressor);
+		m_compressor = NULL;
+	}
+}
+
+// ----------------------------------------------------------------------------
+unsigned int LibDeflateCompressor::compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf)
+{
+	// Compressors are expensive to set up, keep it around for the next file
+	if (m_compressor == NULL)
+	{
+		m_compressor = libdeflate_alloc_compressor(m_level);
+	}
+
+	outBuf.clear();
+	if (m_compressor)
+	{
+		outBuf.resize(libdeflate_zlib_compress_bound(m_compressor, dSize));
+		outBuf.resize(libdeflate_zlib_compress(m_compressor, dBuffer, dSize, &outBuf[0], outBuf.size()));
+	}
+
+	return outBuf.size();
+}
+#endif
+
+#ifdef SWF_USE_LZMA
+// ----------------------------------------------------------------------------
+LZMACompressor::LZMACompressor() :
+	m_preset(LZMA_PRESET_DEFAULT)
+{
+}
+
+// ----------------------------------------------------------------------------
+void LZMACompressor::setTier(Tier tier)
+{
+	// LZMA has no stored mode, the fastest preset is the closest thing
+	static const unsigned int presets[] = { 0, 1, LZMA_PRESET_DEFAULT, 9 | LZMA_PRESET_EXTREME };
+	m_preset = presets[tier];
+}
+
+// ----------------------------------------------------------------------------
+unsigned int LZMACompressor::compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf)
+{
+	outBuf.clear();
+
+	lzma_options_lzma options;
+	if (lzma_lzma_preset(&options, m_preset))
+		return 0;
+
+	// The .lzma ("alone") format is the 5 property bytes, an 8 byte size and the
+	// data. SWF keeps the properties but has no room for the size.
+	lzma_stream stream = LZMA_STREAM_INIT;
+	if (lzma_alone_encoder(&stream, &options) != LZMA_OK)
+		return 0;
+
+	outBuf.resize(dSize + dSize / 2 + 64 * 1024);
+	stream.next_in = dBuffer;
+	stream.avail_in = dSize;
+	stream.next_out = &outBuf[0];
+	stream.avail_out = outBuf.size();
+
+	lzma_ret result = LZMA_OK;
+	while (result == LZMA_OK)
+	{
+		if (stream.avail_out == 0)
+		{
+			size_t used = outBuf.size();
+			outBuf.resize(used * 2);
+			stream.next_out = &outBuf[used];
+			stream.avail_out = outBuf.size() - used;
+		}
+		result = lzma_code(&stream, LZMA_FINISH);
+	}
+
+	size_t outSize = stream.total_out;
+	lzma_end(&stream);
+
+	if (result != LZMA_STREAM_END || outSize < 13)
+	{
+		// @todo throw some error here...
+		outBuf.clear();
+		return 0;
+	}
+
+	outBuf.erase(outBuf.begin() + 5, outBuf.begin() + 13);
+	outBuf.resize(outSize - 8);
+
+	return outBuf.size();
+}
+#endif
+
+// ----------------------------------------------------------------------------
+ZLIBStream::ZLIBStream() :
+	m_stream(NULL),
+	m_output(NULL),
+	m_level(ZLIBCompressor::ZLIB_DEFAULT_COMPRESSION),
+	m_storing(false),
+	m_adler(1),
+	m_totalIn(0),
+	m_active(false),
+	m_allocationCount(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+ZLIBStream::~ZLIBStream()
+{
+	releaseState();
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBStream::releaseState()
+{
+	// Gives back the z_stream and chunk kept for the next begin()
+	if (m_stream)
+	{
+		deleteStream(m_stream);
+		m_stream = NULL;
+	}
+	m_active = false;
+	std::vector<unsigned char>().swap(m_chunk);
+	std::vector<unsigned char>().swap(m_storedPrefix);
+}
+
+// ----------------------------------------------------------------------------
+bool ZLIBStream::initStream()
+{
+	m_active = false;
+	if (m_stream && (deflateReset(m_stream) != Z_OK || deflateParams(m_stream, m_level, Z_DEFAULT_STRATEGY) != Z_OK))
+	{
+		deleteStream(m_stream);
+		m_stream = NULL;
+	}
+
+	if (m_stream == NULL)
+	{
+		// Negative window bits produce a raw deflate stream, the zlib framing is written here
+		m_stream = newStream(&m_allocationCount);
+		if (deflateInit2(m_stream, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			delete m_stream;
+			m_stream = NULL;
+			return false;
+		}
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool ZLIBStream::begin(Output* output, const unsigned char* storedPrefix, unsigned int prefixSize)
+{
+	if (!initStream())
+		return false;
+
+	m_active = true;
+	m_output = output;
+	m_storing = false;
+	m_chunk.resize(CHUNK_SIZE);
+	m_storedPrefix.assign(storedPrefix, storedPrefix + prefixSize);
+	m_adler = adler32(0, Z_NULL, 0);
+	m_totalIn = 0;
+
+	// zlib header: 32K window, the level hint is informational only
+	unsigned char header[7] = { 0x78, 0xda };
+	unsigned int headerSize = 2;
+	if (prefixSize > 0)
+	{
+		// Non-final stored block, it ends byte aligned so the raw deflate data can follow directly
+		assert(prefixSize <= 0xffff);
+		header[2] = 0;
+		header[3] = static_cast<unsigned char>(prefixSize);
+		header[4] = static_cast<unsigned char>(prefixSize >> 8);
+		header[5] = static_cast<unsigned char>(~prefixSize);
+		header[6] = static_cast<unsigned char>(~prefixSize >> 8);
+		headerSize = 7;
+	}
+	if (m_output)
+	{
+		m_output->writeCompressed(header, headerSize);
+		if (prefixSize > 0)
+		{
+			m_output->writeCompressed(storedPrefix, prefixSize);
+		}
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool ZLIBStream::resume(Output* output, const unsigned char* data, unsigned long size, unsigned int prefixSize,
+						unsigned char lastByte, unsigned int lastBits)
+{
+	// Continues a stream written by begin() from a block boundary, the output
+	// before it is kept and only what follows is compressed. data is what the
+	// kept output inflates to, starting with the stored prefix. The boundary
+	// may fall inside a byte, its lastBits low bits are kept and that byte is
+	// written again.
+	assert(prefixSize <= size && lastBits < 8);
+	if (!initStream())
+		return false;
+
+	m_active = true;
+	m_output = output;
+	m_storing = false;
+	m_chunk.resize(CHUNK_SIZE);
+	m_storedPrefix.assign(data, data + prefixSize);
+	m_adler = adler32(0, Z_NULL, 0);
+	m_totalIn = size - prefixSize;
+	for (unsigned long pos = prefixSize; pos < size; )
+	{
+		unsigned int count = static_cast<unsigned int>(std::min(size - pos, 1ul << 30));
+		m_adler = adler32(m_adler, data + pos, count);
+		pos += count;
+	}
+
+	// Matches can reach back into the kept output
+	unsigned int windowSize = static_cast<unsigned int>(std::min(size, 1ul << MAX_WBITS));
+	if (deflateSetDictionary(m_stream, data + size - windowSize, windowSize) != Z_OK ||
+		(lastBits > 0 && deflatePrime(m_stream, lastBits, lastByte & ((1 << lastBits) - 1)) != Z_OK))
+	{
+		m_active = false;
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBStream::write(const unsigned char* data, unsigned int size, bool stored)
+{
+	if (!m_active || size == 0)
+		return;
+
+	// Already compressed data goes into stored blocks
+	if (stored != m_storing && m_level != Z_NO_COMPRESSION)
+	{
+		int result = Z_OK;
+		do
+		{
+			m_stream->next_out = &m_chunk[0];
+			m_stream->avail_out = CHUNK_SIZE;
+			result = deflateParams(m_stream, stored ? Z_NO_COMPRESSION : m_level, Z_DEFAULT_STRATEGY);
+
+			unsigned int outSize = CHUNK_SIZE - m_stream->avail_out;
+			if (outSize > 0 && m_output)
+			{
+				m_output->writeCompressed(&m_chunk[0], outSize);
+			}
+		} while (result == Z_BUF_ERROR);
+		m_storing = stored;
+	}
+
+	m_adler = adler32(m_adler, data, size);
+	m_totalIn += size;
+
+	m_stream->next_in = const_cast<unsigned char*>(data);
+	m_stream->avail_in = size;
+	deflateChunks(Z_NO_FLUSH);
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBStream::flush()
+{
+	// Sync flush: everything written so far can be inflated from the output
+	// handed out, at the cost of a few bytes and some ratio
+	if (!m_active)
+		return;
+
+	m_stream->next_in = Z_NULL;
+	m_stream->avail_in = 0;
+	deflateChunks(Z_SYNC_FLUSH);
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBStream::finish()
+{
+	if (!m_active)
+		return;
+
+	m_stream->next_in = Z_NULL;
+	m_stream->avail_in = 0;
+	deflateChunks(Z_FINISH);
+	m_active = false;
+
+	// The prefix and the deflated data were checksummed separately
+	unsigned long adler = adler32(0, Z_NULL, 0);
+	if (!m_storedPrefix.empty())
+	{
+		adler = adler32(adler, &m_storedPrefix[0], m_storedPrefix.size());
+	}
+	adler = adler32_combine(adler, m_adler, m_totalIn);
+
+	unsigned char trailer[4];
+	trailer[0] = static_cast<unsigned char>(adler >> 24);
+	trailer[1] = static_cast<unsigned char>(adler >> 16);
+	trailer[2] = static_cast<unsigned char>(adler >> 8);
+	trailer[3] = static_cast<unsigned char>(adler);
+	if (m_output)
+	{
+		m_output->writeCompressed(trailer, 4);
+	}
+}
+
+// ----------------------------------------------------------------------------
+unsigned int ZLIBStream::patchStoredPrefix(unsigned int offset, const unsigned char* data, unsigned int size)
+{
+	// Only updates the copy used for the checksum, the caller rewrites the output
+	// at the returned offset (relative to the start of the zlib stream).
+	assert(offset + size <= m_storedPrefix.size());
+	std::copy(data, data + size, m_storedPrefix.begin() + offset);
+	return 7 + offset;
+}
+
+// ----------------------------------------------------------------------------
+void ZLIBStream::deflateChunks(int flush)
+{
+	// Drain the deflater one chunk at a time until it has consumed all the input
+	// (and, when finishing, emitted the final block).
+	int result = Z_OK;
+	do
+	{
+		m_stream->next_out = &m_chunk[0];
+		m_stream->avail_out = CHUNK_SIZE;
+		result = deflate(m_stream, flush);
+
+		unsigned int outSize = CHUNK_SIZE - m_stream->avail_out;
+		if (outSize > 0 && m_output)
+		{
+			m_output->writeCompressed(&m_chunk[0], outSize);
+		}
+	} while (m_stream->avail_out == 0 || (flush == Z_FINISH && result == Z_OK));
+}
@@ -1,8 +1,43 @@
+#pragma once
+
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include "DataSpan.h"
+
+class ThreadPool;
+struct z_stream_s;
 
-class ZLIBCompressor
+// ----------------------------------------------------------------------------
+// Interface SwfWriter compresses the SWF body through. The signature is the
+// first byte of the resulting file ('C' for zlib data, 'Z' for LZMA data).
+class Compressor
 {
-private:
+public:
+	enum Tier
+	{
+		TIER_STORE,		///< No real compression, cheapest possible framing.
+		TIER_FAST,		///< Fastest setting of the backend.
+		TIER_BALANCED,	///< Backend default.
+		TIER_BEST		///< Best ratio regardless of speed.
+	};
+
+public:
+	virtual ~Compressor() {}
+
+	virtual char getSignature() const = 0;
+	virtual void setTier(Tier tier) = 0;
+	virtual unsigned int compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf) = 0;
+
+	// Compresses the concatenation of the spans. Backends that can store the
+	// stored spans verbatim do so, by default they are gathered and compressed.
+	virtual unsigned int compress(const DataSpanList& input, std::vector<unsigned char>& outBuf);
+};
+
+// ----------------------------------------------------------------------------
+class ZLIBCompressor : public Compressor
+{
+public:
 	enum CompressionLevel
 	{
 		ZLIB_BEST_COMPRESSION		= 9,	///< Best but slower compression level.
@@ -14,16 +49,157 @@ private:
 		ZLIB_DEFAULT_COMPRESSION	= ZLIB_BEST_COMPRESSION
 	};
 
+	enum { DEFAULT_BLOCK_SIZE = 128 * 1024 };
+
+private:
+	// One block of a parallel compression, kept with its buffers for the next call
+	struct Block
+	{
+		std::vector<unsigned char> data;
+		std::vector<unsigned char> dictionary;
+		DataSpanList spans;
+		unsigned long adler;
+		bool failed;
+
+		Block() : adler(1), failed(false) {}
+	};
+
 private:
 	CompressionLevel m_quality;
+	ThreadPool* m_threadPool;
+	unsigned int m_blockSize;
 
-	inline unsigned int getMaxCompressionSize(unsigned int inSize) const
-	{
-		return ((inSize) + ((inSize) / 100) + 12 + 1); // from a zlib formula
-	}
+	// zlib state is reset rather than rebuilt between calls
+	z_stream_s* m_stream;
+	std::vector<z_stream_s*> m_blockStreams;	// Raw deflate streams not in use by a block
+	std::mutex m_blockStreamMutex;
+	std::vector<Block> m_blocks;
+	std::atomic<unsigned long> m_allocationCount;
+
+private:
+	ZLIBCompressor(const ZLIBCompressor&);
+	ZLIBCompressor& operator=(const ZLIBCompressor&);
+
+	z_stream_s* resetStream();
+	z_stream_s* acquireBlockStream(int level);
+	void releaseBlockStream(z_stream_s* stream);
+	void deflateBlock(const DataSpanList* input, unsigned long begin, unsigned long end, bool last, int level, Block& block);
+	unsigned int compressBlocks(const DataSpanList& input, unsigned long dSize, std::vector<unsigned char>& outBuf);
 
 public:
 	ZLIBCompressor();
+	virtual ~ZLIBCompressor();
+
+	static CompressionLevel getTierLevel(Tier tier);
+
+	inline void setLevel(CompressionLevel level) { m_quality = level; }
+	inline CompressionLevel getLevel() const { return m_quality; }
+	void setThreadPool(ThreadPool* pool, unsigned int blockSize = DEFAULT_BLOCK_SIZE);
+
+	virtual char getSignature() const { return 'C'; }
+	virtual void setTier(Tier tier);
+	virtual unsigned int compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf);
+	virtual unsigned int compress(const DataSpanList& input, std::vector<unsigned char>& outBuf);
+
+	void releaseState();
+	inline unsigned long getAllocationCount() const { return m_allocationCount; }
+};
+
+#ifdef SWF_USE_LIBDEFLATE
+// ----------------------------------------------------------------------------
+// libdeflate one-shot zlib compression, considerably faster than zlib at the
+// same ratio but without streaming support.
+struct libdeflate_compressor;
+
+class LibDeflateCompressor : public Compressor
+{
+private:
+	int m_level;
+	libdeflate_compressor* m_compressor;
+
+public:
+	LibDeflateCompressor();
+	virtual ~LibDeflateCompressor();
+
+	using Compressor::compress;
+
+	virtual char getSignature() const { return 'C'; }
+	virtual void setTier(Tier tier);
+	virtual unsigned int compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf);
+};
+#endif
+
+#ifdef SWF_USE_LZMA
+// ----------------------------------------------------------------------------
+// LZMA compression for 'ZWS' files (SWF 13+). The output holds the 5 byte
+// LZMA properties followed by the compressed data.
+class LZMACompressor : public Compressor
+{
+private:
+	unsigned int m_preset;
+
+public:
+	LZMACompressor();
+
+	using Compressor::compress;
+
+	virtual char getSignature() const { return 'Z'; }
+	virtual void setTier(Tier tier);
+	virtual unsigned int compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf);
+};
+#endif
+
+// ----------------------------------------------------------------------------
+// Incremental zlib stream. Input is pushed as it becomes available and the
+// compressed output is handed to an Output in fixed-size chunks, so the memory
+// used does not depend on the total amount of data compressed.
+// A short prefix can be emitted as a stored block; it stays byte-for-byte in the
+// output and can be patched after the rest of the stream has been written.
+class ZLIBStream
+{
+public:
+	class Output
+	{
+	public:
+		virtual ~Output() {}
+		virtual void writeCompressed(const unsigned char* data, unsigned int size) = 0;
+	};
+
+	enum { CHUNK_SIZE = 64 * 1024 };
+
+private:
+	z_stream_s* m_stream;
+	Output* m_output;
+	int m_level;
+	bool m_storing;
+	std::vector<unsigned char> m_chunk;
+	std::vector<unsigned char> m_storedPrefix;
+	unsigned long m_adler;			// adler32 of everything after the stored prefix
+	unsigned long m_totalIn;
+	bool m_active;					// Between begin() and finish(), the z_stream is kept for reuse
+	std::atomic<unsigned long> m_allocationCount;
+
+private:
+	bool initStream();
+	void deflateChunks(int flush);
+
+public:
+	ZLIBStream();
+	~ZLIBStream();
+
+	inline void setLevel(int level) { m_level = level; }
+
+	bool begin(Output* output, const unsigned char* storedPrefix = 0, unsigned int prefixSize = 0);
+	bool resume(Output* output, const unsigned char* data, unsigned long size, unsigned int prefixSize,
+				unsigned char lastByte, unsigned int lastBits);
+	void write(const unsigned char* data, unsigned int size, bool stored = false);
+	void flush();
+	void finish();
+
+	unsigned int patchStoredPrefix(unsigned int offset, const unsigned char* data, unsigned int size);
+
+	inline unsigned long getTotalIn() const { return m_storedPrefix.size() + m_totalIn; }
 
-	unsigned int compress(const unsigned char* dBuffer, unsigned int dSize, std::vector<unsigned char>& outBuf);
+	void releaseState();
+	inline unsigned long getAllocationCount() const { return m_allocationCount; }
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Piece of a scatter-gather list. Stored spans hold data that is already
+// compressed (JPEG, MP3...) and should not be deflated again.
+struct DataSpan
+{
+	const unsigned char* data;
+	unsigned long size;
+	bool stored;
+
+	DataSpan() : data(0), size(0), stored(false) {}
+	DataSpan(const unsigned char* _data, unsigned long _size, bool _stored = false) :
+		data(_data),
+		size(_size),
+		stored(_stored)
+	{
+	}
+};
+typedef std::vector<DataSpan> DataSpanList;
@@ -1,17 +1,20 @@
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include "FileWriter.h"
+#include "ThreadPool.h"
 
 // ----------------------------------------------------------------------------
-#if LITTLE_ENDIAN
-	#define FIRST_BYTE_IDX(x, y)	(x)
-	#define NEXT_BYTE_IDX(x)		++(x)
-#else
-	#define FIRST_BYTE_IDX(x, y)	(y)
-	#define NEXT_BYTE_IDX(x)		--(x)
-#endif
-
-// ----------------------------------------------------------------------------
-FileWriter::FileWriter() : m_pos(0)
+FileWriter::FileWriter() : 
+	m_sink(NULL),
+	m_pos(0),
+	m_streaming(false),
+	m_reopened(false),
+	m_streamFailed(false),
+	m_scratchDepth(0),
+	m_statsEnabled(false),
+	m_emitTimer(false),
+	m_inlineTime(0)
 {
 	initWriteBits();
 }
@@ -19,26 +22,242 @@ FileWriter::FileWriter() : m_pos(0)
 // ----------------------------------------------------------------------------
 FileWriter::~FileWriter()
 {
+	waitClose();
 }
 
 // ----------------------------------------------------------------------------
 void FileWriter::open(const std::wstring& filename)
 {
-	m_filename = filename;
+	std::unique_ptr<OutputSink> sink(new FileSink(filename));
+	open(sink.get());
+	m_ownedSink = std::move(sink);
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::close()
+void FileWriter::open(OutputSink* sink)
 {
-	writeBuffer();
+	// Not owned, the sink has to stay around until the file is closed (and the
+	// result of closeAsync() is ready)
+	m_sink = sink;
+	m_ownedSink.reset();
+	m_emitTimer = StatsTimer(collectStats());
+	m_inlineTime = 0;
+	m_streamFailed = false;
+
+	if (m_streaming)
+	{
+		m_streamFailed = !m_sink->beginStream();
+	}
+}
 
-	m_buffer.clear();
-	m_pos = 0;
-	m_filename.clear();
+// ----------------------------------------------------------------------------
+bool FileWriter::reopen(const std::wstring& filename, unsigned long filePos, unsigned long pos)
+{
+	// The file on disk is kept up to filePos and written from there on, what
+	// follows is replaced. The document goes on at position pos as if what
+	// comes before had been streamed out.
+	assert(m_sink == NULL && m_pos == 0);
+	waitClose();
+
+	std::unique_ptr<FileSink> sink(new FileSink(filename));
+	if (!sink->resumeStream(filePos))
+		return false;
+
+	m_sink = sink.get();
+	m_ownedSink = std::move(sink);
+	m_emitTimer = StatsTimer(collectStats());
+	m_inlineTime = 0;
+	m_reopened = true;
+	m_streamFailed = false;
+	m_buffer.clear(pos);
+	m_storedRanges.clear();
+	m_pos = pos;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool FileWriter::close()
+{
+	assert(m_scratchDepth == 0);
+	waitClose();
+	endDocumentStats();
 
+	bool success = false;
+	if (isStreaming())
+	{
+		flushStream(getFileSize());
+		finishStream();
+		if (m_sink)
+		{
+			success = m_sink->endStream() && !m_streamFailed;
+		}
+		m_buffer.clear();
+		m_storedRanges.clear();
+		m_sink = NULL;
+		m_ownedSink.reset();
+	}
+	else
+	{
+		takeClosedFile();
+		success = writeBuffer(m_closed);
+		releaseClosedFile();
+	}
+
+	resetFile();
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+FileWriter::CloseResult FileWriter::closeAsync()
+{
+	// Compression and disk I/O happen on a writer thread. The writer can be
+	// opened again right away, one file can be pending while the next is built.
+	if (isStreaming())
+	{
+		// Only the tail of the stream is left, no point in a thread
+		std::promise<bool> done;
+		done.set_value(close());
+		return done.get_future().share();
+	}
+
+	assert(m_scratchDepth == 0);
+	waitClose();
+	endDocumentStats();
+	takeClosedFile();
+	resetFile();
+
+	if (!m_closeThread)
+	{
+		m_closeThread.reset(new ThreadPool(1));
+	}
+
+	std::shared_ptr<std::promise<bool> > done(new std::promise<bool>);
+	m_pendingClose = done->get_future().share();
+	m_closeThread->submit([this, done]()
+	{
+		bool success = writeBuffer(m_closed);
+		releaseClosedFile();
+		done->set_value(success);
+	});
+
+	return m_pendingClose;
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::waitClose()
+{
+	// Returns once the file handed to closeAsync() is written out
+	if (m_pendingClose.valid())
+	{
+		m_pendingClose.wait();
+		m_pendingClose = CloseResult();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::endDocumentStats()
+{
+	// Building is over, whatever is still to come is compression and I/O
+	if (!m_emitTimer.isActive())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.emitTime += m_emitTimer.getElapsed() - m_inlineTime;
+	m_stats.documentCount += 1;
+	m_stats.documentBytes += getFileSize();
+	m_stats.peakBufferSize = std::max<unsigned long long>(m_stats.peakBufferSize, getBufferedSize());
+	m_emitTimer = StatsTimer(false);
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::setStatsEnabled(bool enabled)
+{
+	// Compile with SWF_ENABLE_STATS, otherwise this is ignored
+	waitClose();
+	m_statsEnabled = enabled;
+}
+
+// ----------------------------------------------------------------------------
+WriterStats FileWriter::getStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_stats;
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.clear();
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::addCompressTime(double seconds)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.compressTime += seconds;
+	if (isStreaming())
+	{
+		m_inlineTime += seconds;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::addIOTime(double seconds, unsigned long bytes)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.ioTime += seconds;
+	m_stats.outputBytes += bytes;
+	if (isStreaming())
+	{
+		m_inlineTime += seconds;
+	}
+}
+
+// ----------------------------------------------------------------------------
+double FileWriter::getIOTime()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_stats.ioTime;
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::takeClosedFile()
+{
+	// The content moves to the back buffer and the emptied back buffer becomes
+	// the one the next file is written to
+	m_closed.sink = m_sink;
+	m_closed.ownedSink = std::move(m_ownedSink);
+	m_closed.buffer.swap(m_buffer);
+	m_closed.storedRanges.swap(m_storedRanges);
+	m_sink = NULL;
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::releaseClosedFile()
+{
+	m_closed.buffer.clear();
+	m_closed.storedRanges.clear();
+	m_closed.sink = NULL;
+	m_closed.ownedSink.reset();
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::resetFile()
+{
+	m_pos = 0;
+	m_reopened = false;
 	initWriteBits();
 }
 
+// ----------------------------------------------------------------------------
+void FileWriter::setStreaming(bool streaming)
+{
+	// Only meaningful before open()
+	assert(m_sink == NULL && m_pos == 0);
+	m_streaming = streaming;
+}
+
 // ----------------------------------------------------------------------------
 unsigned long FileWriter::getPosition()
 {
@@ -54,133 +273,332 @@ void FileWriter::setPosition(unsigned long pos)
 // ----------------------------------------------------------------------------
 unsigned long FileWriter::getFileSize()
 {
-	return m_buffer.size();
+	return m_buffer.getEnd();
+}
+
+// ----------------------------------------------------------------------------
+unsigned long FileWriter::getBufferedSize()
+{
+	return m_buffer.getSize();
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::readData(unsigned long pos, unsigned char* data, unsigned long size)
+{
+	m_buffer.read(pos, data, size);
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::beginScratch()
+{
+	// Everything written from here on goes to an empty buffer starting at
+	// position 0, until endScratch() appends it to the enclosing level.
+	if (m_scratchDepth == m_scratchList.size())
+	{
+		m_scratchList.push_back(std::unique_ptr<Scratch>(new Scratch()));
+	}
+
+	Scratch& scratch = *m_scratchList[m_scratchDepth++];
+	scratch.buffer.swap(m_buffer);
+	scratch.storedRanges.swap(m_storedRanges);
+	scratch.pos = m_pos;
+	m_pos = 0;
 }
 
 // ----------------------------------------------------------------------------
-unsigned long FileWriter::resizeFile(unsigned long size)
+unsigned long FileWriter::endScratch(const unsigned char* prefix, unsigned long prefixSize)
 {
-	m_buffer.resize(size);
-	return m_buffer.size();
+	// Appends prefix and the scratch content to the enclosing level, returns
+	// the position the content starts at there.
+	assert(m_scratchDepth > 0);
+	Scratch& scratch = *m_scratchList[--m_scratchDepth];
+	scratch.buffer.swap(m_buffer);
+	scratch.storedRanges.swap(m_storedRanges);
+	m_pos = scratch.pos;
+	assert(m_pos == getFileSize());
+
+	writeData(prefix, prefixSize);
+	unsigned long base = m_pos;
+	m_pos += scratch.buffer.getSize();
+	unsigned long copied = m_buffer.splice(scratch.buffer);
+	if (collectStats())
+	{
+		m_stats.movedBytes += copied;
+	}
+
+	for (RangeList::const_iterator i = scratch.storedRanges.begin(); i != scratch.storedRanges.end(); ++i)
+	{
+		m_storedRanges.push_back(Range(base + i->begin, i->size));
+	}
+	scratch.storedRanges.clear();
+
+	return base;
 }
 
 // ----------------------------------------------------------------------------
-unsigned char* FileWriter::getBufferAtPos(unsigned long pos)
+void FileWriter::patchData(unsigned int depth, unsigned long pos, const unsigned char* data, unsigned long size)
 {
-	return (&m_buffer[0]+pos);
+	// Overwrites already written bytes of the level at depth, 0 being the file
+	assert(depth <= m_scratchDepth);
+	if (depth == m_scratchDepth)
+	{
+		m_buffer.write(pos, data, size);
+	}
+	else
+	{
+		m_scratchList[depth]->buffer.write(pos, data, size);
+	}
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::shiftContent(unsigned long startPos, unsigned long size, int offset)
+static void collectSpans(const SegmentedBuffer& buffer, const FileWriter::RangeList& storedRanges, unsigned long begin, unsigned long end, DataSpanList& spans)
 {
-	// @todo...
-	bool resize = false;
-	if (startPos+size == m_buffer.size())
-		resize = true;
-	memmove(&m_buffer[startPos]+offset, &m_buffer[startPos], size);
-	m_pos = startPos + size + offset;
-	m_buffer.resize(m_pos);
+	// Scatter-gather view of [begin, end), nothing is copied. Referenced payloads
+	// come back as stored spans, copied payloads are split out by their ranges.
+	DataSpanList bufferSpans;
+	buffer.getSpans(begin, end, bufferSpans);
+
+	unsigned long pos = begin;
+	FileWriter::RangeList::const_iterator range = storedRanges.begin();
+	for (DataSpanList::const_iterator i = bufferSpans.begin(); i != bufferSpans.end(); ++i)
+	{
+		unsigned long spanBegin = pos;
+		unsigned long spanEnd = pos + i->size;
+		pos = spanEnd;
+
+		if (i->stored)
+		{
+			spans.push_back(*i);
+			continue;
+		}
+
+		while (spanBegin < spanEnd)
+		{
+			while (range != storedRanges.end() && range->begin + range->size <= spanBegin)
+			{
+				++range;
+			}
+
+			bool stored = (range != storedRanges.end() && range->begin <= spanBegin);
+			unsigned long pieceEnd = spanEnd;
+			if (range != storedRanges.end())
+			{
+				pieceEnd = std::min(pieceEnd, stored ? range->begin + range->size : range->begin);
+			}
+
+			spans.push_back(DataSpan(i->data + (spanBegin - (spanEnd - i->size)), pieceEnd - spanBegin, stored));
+			spanBegin = pieceEnd;
+		}
+	}
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::writeBuffer()
+void FileWriter::getSpans(unsigned long begin, unsigned long end, DataSpanList& spans) const
 {
-	FILE *fp = _wfopen(m_filename.c_str(), L"wb");
-	if (fp)
+	collectSpans(m_buffer, m_storedRanges, begin, end, spans);
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::getSpans(const ClosedFile& file, unsigned long begin, unsigned long end, DataSpanList& spans)
+{
+	collectSpans(file.buffer, file.storedRanges, begin, end, spans);
+}
+
+// ----------------------------------------------------------------------------
+bool FileWriter::writeBuffer(ClosedFile& file)
+{
+	OutputSink::File output;
+	getSpans(file, 0, file.buffer.getEnd(), output.spans);
+	output.buffer = &file.buffer;
+	return writeFile(file, output);
+}
+
+// ----------------------------------------------------------------------------
+bool FileWriter::writeFile(ClosedFile& file, OutputSink::File& output)
+{
+	// The sink may take over the buffers of output
+	StatsTimer timer(collectStats());
+	unsigned long size = timer.isActive() ? output.getSize() : 0;
+	bool success = file.sink && file.sink->writeFile(output);
+
+	if (timer.isActive())
 	{
-		fwrite(&m_buffer[0], 1, m_buffer.size(), fp);
-		fclose(fp);
+		addIOTime(timer.getElapsed(), size);
 	}
+	return success;
 }
 
 // ----------------------------------------------------------------------------
-unsigned long FileWriter::ensureBufferSize(unsigned int size)
+void FileWriter::flushStream(unsigned long endPos)
 {
-	unsigned long sizeNeeded = m_pos + size;
-	unsigned long bufferSize = m_buffer.size();
-	if (sizeNeeded > bufferSize)
+	// Hand everything before endPos to the stream and drop it from memory.
+	// Positions stay logical, so content that went out can no longer be patched.
+	assert(isStreaming() && endPos >= m_buffer.getBegin() && endPos <= getFileSize());
+	if (endPos > m_buffer.getBegin())
 	{
-		m_buffer.resize(sizeNeeded);
-		bufferSize = m_buffer.size();
-		assert(sizeNeeded == bufferSize);
+		DataSpanList spans;
+		getSpans(m_buffer.getBegin(), endPos, spans);
+		writeStreamData(m_buffer.getBegin(), spans);
+		m_buffer.discardFront(endPos);
+
+		RangeList::iterator i = m_storedRanges.begin();
+		while (i != m_storedRanges.end() && i->begin + i->size <= endPos)
+		{
+			++i;
+		}
+		m_storedRanges.erase(m_storedRanges.begin(), i);
+		if (!m_storedRanges.empty() && m_storedRanges.front().begin < endPos)
+		{
+			m_storedRanges.front().size -= endPos - m_storedRanges.front().begin;
+			m_storedRanges.front().begin = endPos;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::writeStreamData(unsigned long /*pos*/, const DataSpanList& spans)
+{
+	for (DataSpanList::const_iterator i = spans.begin(); i != spans.end(); ++i)
+	{
+		writeFileData(i->data, i->size);
 	}
+}
 
-	return bufferSize;
+// ----------------------------------------------------------------------------
+void FileWriter::finishStream()
+{
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::writeByte(unsigned char value)
+bool FileWriter::writeFileData(const unsigned char* data, unsigned long size)
 {
-	if (m_pos == m_buffer.size())
+	StatsTimer timer(collectStats());
+	bool success = m_sink && m_sink->writeStream(data, size);
+	m_streamFailed = m_streamFailed || !success;
+	if (timer.isActive())
 	{
-		m_buffer.push_back(value);
+		addIOTime(timer.getElapsed(), size);
 	}
-	else
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool FileWriter::flushFileData()
+{
+	StatsTimer timer(collectStats());
+	bool success = m_sink && m_sink->flushStream();
+	m_streamFailed = m_streamFailed || !success;
+	if (timer.isActive())
 	{
-		ensureBufferSize(1);
-		m_buffer[m_pos] = value;
+		addIOTime(timer.getElapsed(), 0);
 	}
+	return success;
+}
 
-	m_pos += 1;
+// ----------------------------------------------------------------------------
+bool FileWriter::writeFileDataAt(unsigned long filePos, const unsigned char* data, unsigned long size)
+{
+	// Overwrites bytes already counted as output
+	StatsTimer timer(collectStats());
+	bool success = m_sink && m_sink->patchStream(filePos, data, size);
+	m_streamFailed = m_streamFailed || !success;
+	if (timer.isActive())
+	{
+		addIOTime(timer.getElapsed(), 0);
+	}
+	return success;
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::writeWord(unsigned short value)
+void FileWriter::writeByte(unsigned char value)
 {
-	// unsigned int idx = FIRST_BYTE_IDX(0, 1);
-	unsigned char* pValue = reinterpret_cast<unsigned char*>(&value);
-	if (m_pos == m_buffer.size())
+	if (m_pos == m_buffer.getEnd())
 	{
-		m_buffer.push_back(pValue[0]);
-		m_buffer.push_back(pValue[1]);
+		m_buffer.append(value);
 	}
 	else
 	{
-		ensureBufferSize(2);
-		m_buffer[m_pos]   = pValue[0];
-		m_buffer[m_pos+1] = pValue[1];
+		m_buffer.write(m_pos, &value, 1);
 	}
 
-	m_pos += 2;
+	m_pos += 1;
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::writeWord(unsigned short value)
+{
+	// SWF is little-endian whatever the host is
+	unsigned char bytes[2];
+	bytes[0] = static_cast<unsigned char>(value);
+	bytes[1] = static_cast<unsigned char>(value >> 8);
+	writeData(bytes, sizeof(bytes));
 }
 
 // ----------------------------------------------------------------------------
 void FileWriter::writeLong(unsigned long value)
 {
-	unsigned char* pValue = reinterpret_cast<unsigned char*>(&value);
-	if (m_pos == m_buffer.size())
+	unsigned char bytes[4];
+	bytes[0] = static_cast<unsigned char>(value);
+	bytes[1] = static_cast<unsigned char>(value >> 8);
+	bytes[2] = static_cast<unsigned char>(value >> 16);
+	bytes[3] = static_cast<unsigned char>(value >> 24);
+	writeData(bytes, sizeof(bytes));
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::writeData(const Buffer& value)
+{
+	if (!value.empty())
+	{
+		writeData(&value[0], value.size());
+	}
+}
+
+// ----------------------------------------------------------------------------
+void FileWriter::writeData(const unsigned char* data, unsigned long size)
+{
+	if (m_pos == m_buffer.getEnd())
 	{
-		m_buffer.push_back(pValue[0]);
-		m_buffer.push_back(pValue[1]);
-		m_buffer.push_back(pValue[2]);
-		m_buffer.push_back(pValue[3]);
+		m_buffer.append(data, size);
 	}
 	else
 	{
-		ensureBufferSize(4);
-		m_buffer[m_pos]	  = pValue[0];
-		m_buffer[m_pos+1] = pValue[1];
-		m_buffer[m_pos+2] = pValue[2];
-		m_buffer[m_pos+3] = pValue[3];
+		m_buffer.write(m_pos, data, size);
 	}
 
-	m_pos += 4;
+	m_pos += size;
 }
 
 // ----------------------------------------------------------------------------
-void FileWriter::writeData(const Buffer& value)
+void FileWriter::writePayload(const Buffer& value)
 {
-	unsigned long bufferSize = value.size();
-	unsigned long sizeNeeded = m_pos + bufferSize;
+	// Same as writeData, but remembers that the bytes are already compressed
+	// (JPEG, MP3...) so the compressor can store them instead of deflating them.
+	unsigned long begin = m_pos;
+	writeData(value);
 
-	if (m_buffer.size() < sizeNeeded)
+	if (value.size() >= MIN_STORED_RANGE_SIZE)
 	{
-		m_buffer.resize(sizeNeeded);
-		assert(m_buffer.size() >= sizeNeeded);
+		if (!m_storedRanges.empty() && m_storedRanges.back().begin + m_storedRanges.back().size == begin)
+		{
+			m_storedRanges.back().size += value.size();
+		}
+		else
+		{
+			assert(m_storedRanges.empty() || m_storedRanges.back().begin + m_storedRanges.back().size < begin);
+			m_storedRanges.push_back(Range(begin, value.size()));
+		}
 	}
-	std::copy(value.begin(), value.end(), m_buffer.begin()+m_pos);
+}
 
-	m_pos += bufferSize;
+// ----------------------------------------------------------------------------
+void FileWriter::writePayload(const std::shared_ptr<const void>& owner, const unsigned char* data, unsigned long size)
+{
+	// Referenced rather than copied, the bytes are only read again by the final
+	// write (or the compressor). Only appending is supported.
+	assert(m_pos == getFileSize());
+	m_buffer.appendExternal(owner, data, size);
+	m_pos += size;
 }
 
 // ----------------------------------------------------------------------------
@@ -189,23 +607,24 @@ void FileWriter::writeString(const std::wstring& value)
 	unsigned int len = value.length() + 1;
 
 	// @todo: We really should write a routing to convert the wstring to UTF-8...
-	if (m_pos == m_buffer.size())
+	if (m_pos == m_buffer.getEnd())
 	{
 		for (std::wstring::const_iterator i = value.begin(); i != value.end(); ++i)
 		{
-			m_buffer.push_back(static_cast<unsigned char>(*i));
+			m_buffer.append(static_cast<unsigned char>(*i));
 		}
-		m_buffer.push_back(0);
+		m_buffer.append(0);
 	}
 	else
 	{
-		unsigned long idx = m_pos;
-		ensureBufferSize(len);
+		Buffer bytes;
+		bytes.reserve(len);
 		for (std::wstring::const_iterator i = value.begin(); i != value.end(); ++i)
 		{
-			m_buffer[idx++] = static_cast<unsigned char>(*i);
+			bytes.push_back(static_cast<unsigned char>(*i));
 		}
-		m_buffer[idx] = 0;
+		bytes.push_back(0);
+		m_buffer.write(m_pos, &bytes[0], len);
 	}
 
 	m_pos += len;
@@ -214,46 +633,17 @@ void FileWriter::writeString(const std::wstring& value)
 // ----------------------------------------------------------------------------
 void FileWriter::initWriteBits()
 {
-	m_writeBitPos = 8;
-	m_writeBitBuf = 0;
+	m_bitWriter.reset();
 }
 
 // ----------------------------------------------------------------------------
 void FileWriter::flushWriteBits()
 {
-	//dump remaining bits
-	if (m_writeBitPos < 8)
+	// Bit fields are only written out here, no byte may be written in between
+	if (!m_bitWriter.isEmpty())
 	{
-		writeByte(static_cast<unsigned char>(m_writeBitBuf));
-		initWriteBits();
+		m_bitWriter.finish();
+		writeData(m_bitWriter.getData(), m_bitWriter.getSize());
+		m_bitWriter.reset();
 	}
 }
-
-// ----------------------------------------------------------------------------
-void FileWriter::writeBits(int value, unsigned int numBits)
-{
-	for (;;)
-	{
-		// Mask off any extra bits.
-		value &= (unsigned int) 0xffffffff >> (32 - numBits);
-
-		// The number of bits more than the buffer will hold
-		int	s = numBits - m_writeBitPos;
-		if (s <= 0)
-		{
-			// This fits in the buffer, add it and finish.
-			m_writeBitBuf |= value << -s;
-			m_writeBitPos -= numBits;	// We used x bits in the buffer.
-			return;
-		}
-		else
-		{
-			// This fills the buffer, fill the remaining space and try again.
-			m_writeBitBuf |= value >> s;
-			numBits -= m_writeBitPos;	// We placed x bits in the buffer.
-			writeByte(static_cast<unsigned char>(m_writeBitBuf));
-			m_writeBitBuf = 0;
-			m_writeBitPos = 8;
-		}
-	}
-}
\ No newline at end of file
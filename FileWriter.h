@@ -1,48 +1,173 @@
+#pragma once
+
+#include <stdio.h>
 #include <vector>
 #include <string>
+#include <memory>
+#include <future>
+#include <mutex>
+#include "DataSpan.h"
+#include "SegmentedBuffer.h"
+#include "BitWriter.h"
+#include "WriterStats.h"
+#include "OutputSink.h"
+
+class ThreadPool;
 
 class FileWriter
 {
 public:
 	typedef std::vector<unsigned char> Buffer;
 
+	// Amount of completed content buffered before it is pushed to disk in streaming mode.
+	enum { STREAM_FLUSH_SIZE = 64 * 1024 };
+
+	// Payloads smaller than this are not worth tracking as stored ranges.
+	enum { MIN_STORED_RANGE_SIZE = 1024 };
+
+	// Range of the file holding an opaque, already compressed payload
+	struct Range
+	{
+		unsigned long begin;
+		unsigned long size;
+
+		Range() : begin(0), size(0) {}
+		Range(unsigned long _begin, unsigned long _size) : begin(_begin), size(_size) {}
+	};
+	typedef std::vector<Range> RangeList;
+
+	// Content of a closed file, kept while it is written out
+	struct ClosedFile
+	{
+		OutputSink* sink;
+		std::unique_ptr<OutputSink> ownedSink;
+		SegmentedBuffer buffer;
+		RangeList storedRanges;
+
+		ClosedFile() : sink(NULL) {}
+	};
+
+	typedef std::shared_future<bool> CloseResult;
+
+private:
+	// Content of an enclosing level while a scratch buffer is open
+	struct Scratch
+	{
+		SegmentedBuffer buffer;
+		RangeList storedRanges;
+		unsigned long pos;
+
+		Scratch() : pos(0) {}
+	};
+	typedef std::vector<std::unique_ptr<Scratch> > ScratchList;
+
 private:
-	std::wstring m_filename;
-	Buffer m_buffer;
+	OutputSink* m_sink;
+	std::unique_ptr<OutputSink> m_ownedSink;	// Set when opened by filename
+	SegmentedBuffer m_buffer;	// Positions are logical, content before getBegin() has been streamed out
 	unsigned long m_pos;
 
-	unsigned int m_writeBitPos;
-	unsigned int m_writeBitBuf;
+	bool m_streaming;
+	bool m_reopened;			// Continues a file on disk, streams whatever the setting
+	bool m_streamFailed;		// A write, flush or patch of the stream failed, until the next open
+
+	RangeList m_storedRanges;	// Sorted by position, only for copied payloads
+
+	ScratchList m_scratchList;	// Kept around for reuse, only the first m_scratchDepth are in use
+	unsigned int m_scratchDepth;
+
+	BitWriter m_bitWriter;
+
+	// Back buffer of closeAsync(), written out on m_closeThread
+	ClosedFile m_closed;
+	std::unique_ptr<ThreadPool> m_closeThread;
+	CloseResult m_pendingClose;
+
+	// Stats, the closing side is updated under m_statsMutex as it may run on m_closeThread
+	WriterStats m_stats;
+	bool m_statsEnabled;
+	std::mutex m_statsMutex;
+	StatsTimer m_emitTimer;
+	double m_inlineTime;		// Compression and I/O of the streamed document being built
 
 private:
-	unsigned long ensureBufferSize(unsigned int size);
+	void takeClosedFile();
+	void releaseClosedFile();
+	void resetFile();
+	void endDocumentStats();
 
 protected:
+	bool reopen(const std::wstring& filename, unsigned long filePos, unsigned long pos);
+	inline bool isReopened() const { return m_reopened; }
+
 	unsigned long getPosition();
 	void setPosition(unsigned long pos);
 	unsigned long getFileSize();
-	unsigned long resizeFile(unsigned long size);
-	unsigned char *getBufferAtPos(unsigned long pos);
+	unsigned long getBufferedSize();
+	void readData(unsigned long pos, unsigned char* data, unsigned long size);
+	inline const RangeList& getStoredRanges() const { return m_storedRanges; }
+
+	void beginScratch();
+	unsigned long endScratch(const unsigned char* prefix, unsigned long prefixSize);
+	inline unsigned int getScratchDepth() const { return m_scratchDepth; }
+	void patchData(unsigned int depth, unsigned long pos, const unsigned char* data, unsigned long size);
+
+	void getSpans(unsigned long begin, unsigned long end, DataSpanList& spans) const;
+	static void getSpans(const ClosedFile& file, unsigned long begin, unsigned long end, DataSpanList& spans);
+
+	void flushStream(unsigned long endPos);
+	bool writeFile(ClosedFile& file, OutputSink::File& output);
+	void waitClose();
+	bool writeFileData(const unsigned char* data, unsigned long size);
+	bool writeFileDataAt(unsigned long filePos, const unsigned char* data, unsigned long size);
+	bool flushFileData();
+
+	inline bool collectStats() const
+	{
+#ifdef SWF_ENABLE_STATS
+		return m_statsEnabled;
+#else
+		return false;
+#endif
+	}
+	inline WriterStats& getStatsRecord() { return m_stats; }	// Fields only updated while building
+	void addCompressTime(double seconds);
+	void addIOTime(double seconds, unsigned long bytes);
+	double getIOTime();
 
 protected:
-	virtual void writeBuffer();
+	virtual bool writeBuffer(ClosedFile& file);
+	virtual void writeStreamData(unsigned long pos, const DataSpanList& spans);
+	virtual void finishStream();
 
 public:
 	FileWriter();
 	virtual ~FileWriter();
 
 	virtual void open(const std::wstring& filename);
-	virtual void close();
+	virtual void open(OutputSink* sink);
+	// False when the file could not be written, for a stream when any part of it failed
+	virtual bool close();
+	virtual CloseResult closeAsync();
+
+	void setStreaming(bool streaming);
+	inline bool isStreaming() const { return m_streaming || m_reopened; }
+
+	void setStatsEnabled(bool enabled);
+	inline bool isStatsEnabled() const { return collectStats(); }
+	WriterStats getStats();
+	void resetStats();
 
 	void initWriteBits();
 	void flushWriteBits();
-	void writeBits(int value, unsigned int numBits);
+	inline void writeBits(int value, unsigned int numBits) { m_bitWriter.writeBits(value, numBits); }
 
 	void writeByte(unsigned char value);
 	void writeWord(unsigned short value);
 	void writeLong(unsigned long value);
 	void writeData(const Buffer& value);
+	void writeData(const unsigned char* data, unsigned long size);
+	void writePayload(const Buffer& value);
+	void writePayload(const std::shared_ptr<const void>& owner, const unsigned char* data, unsigned long size);
 	void writeString(const std::wstring& value);
-
-	void shiftContent(unsigned long startPos, unsigned long size, int offset);
 };
@@ -0,0 +1,119 @@
+#include "Hash.h"
+
+// ----------------------------------------------------------------------------
+static const unsigned long long PRIME64_1 = 11400714785074694791ULL;
+static const unsigned long long PRIME64_2 = 14029467366897019727ULL;
+static const unsigned long long PRIME64_3 = 1609587929392839161ULL;
+static const unsigned long long PRIME64_4 = 9650029242287828579ULL;
+static const unsigned long long PRIME64_5 = 2870177450012600261ULL;
+
+// ----------------------------------------------------------------------------
+static inline unsigned long long rotateLeft(unsigned long long value, unsigned int count)
+{
+	return (value << count) | (value >> (64 - count));
+}
+
+// ----------------------------------------------------------------------------
+static inline unsigned long long readLong64(const unsigned char* p)
+{
+	return static_cast<unsigned long long>(p[0])		|
+		   static_cast<unsigned long long>(p[1]) << 8	|
+		   static_cast<unsigned long long>(p[2]) << 16	|
+		   static_cast<unsigned long long>(p[3]) << 24	|
+		   static_cast<unsigned long long>(p[4]) << 32	|
+		   static_cast<unsigned long long>(p[5]) << 40	|
+		   static_cast<unsigned long long>(p[6]) << 48	|
+		   static_cast<unsigned long long>(p[7]) << 56;
+}
+
+// ----------------------------------------------------------------------------
+static inline unsigned long long readLong32(const unsigned char* p)
+{
+	return static_cast<unsigned long long>(p[0])		|
+		   static_cast<unsigned long long>(p[1]) << 8	|
+		   static_cast<unsigned long long>(p[2]) << 16	|
+		   static_cast<unsigned long long>(p[3]) << 24;
+}
+
+// ----------------------------------------------------------------------------
+static inline unsigned long long hashRound(unsigned long long acc, unsigned long long input)
+{
+	acc += input * PRIME64_2;
+	acc = rotateLeft(acc, 31);
+	return acc * PRIME64_1;
+}
+
+// ----------------------------------------------------------------------------
+static inline unsigned long long mergeRound(unsigned long long acc, unsigned long long value)
+{
+	acc ^= hashRound(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+// ----------------------------------------------------------------------------
+unsigned long long hashXXH64(const void* data, unsigned long size, unsigned long long seed)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	unsigned long long hash;
+
+	if (size >= 32)
+	{
+		// Four independent lanes over 32 byte stripes
+		unsigned long long v1 = seed + PRIME64_1 + PRIME64_2;
+		unsigned long long v2 = seed + PRIME64_2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - PRIME64_1;
+
+		const unsigned char* limit = end - 32;
+		do
+		{
+			v1 = hashRound(v1, readLong64(p));
+			v2 = hashRound(v2, readLong64(p + 8));
+			v3 = hashRound(v3, readLong64(p + 16));
+			v4 = hashRound(v4, readLong64(p + 24));
+			p += 32;
+		}
+		while (p <= limit);
+
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+	{
+		hash = seed + PRIME64_5;
+	}
+
+	hash += size;
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= hashRound(0, readLong64(p));
+		hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (p + 4 <= end)
+	{
+		hash ^= readLong32(p) * PRIME64_1;
+		hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	for (; p < end; ++p)
+	{
+		hash ^= *p * PRIME64_5;
+		hash = rotateLeft(hash, 11) * PRIME64_1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// ----------------------------------------------------------------------------
+// XXH64 of a block of memory, used to recognize assets that were seen before.
+// Not cryptographic.
+unsigned long long hashXXH64(const void* data, unsigned long size, unsigned long long seed = 0);
@@ -0,0 +1,200 @@
+#include <string.h>
+#include <algorithm>
+#include "MP3Stream.h"
+
+// ----------------------------------------------------------------------------
+// Layer III bitrates in kbit/s by bitrate index, MPEG 1 and MPEG 2/2.5
+static const unsigned short s_bitrates[2][15] =
+{
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+};
+
+// Sampling rates by version (2.5, reserved, 2, 1) and rate index
+static const unsigned int s_sampleRates[4][3] =
+{
+	{ 11025, 12000, 8000 },
+	{ 0, 0, 0 },
+	{ 22050, 24000, 16000 },
+	{ 44100, 48000, 32000 }
+};
+
+// ----------------------------------------------------------------------------
+MP3Stream::MP3Stream() :
+	m_sampleRate(0),
+	m_channels(0),
+	m_samplesPerFrame(0),
+	m_nextFrame(0),
+	m_emittedSamples(0),
+	m_blockIndex(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool MP3Stream::parseHeader(const unsigned char* data, unsigned long available, FrameHeader& header)
+{
+	if (available < 4 || data[0] != 0xff || (data[1] & 0xe0) != 0xe0)
+		return false;
+
+	unsigned int version = (data[1] >> 3) & 3;
+	unsigned int layer = (data[1] >> 1) & 3;
+	unsigned int bitrateIndex = data[2] >> 4;
+	unsigned int rateIndex = (data[2] >> 2) & 3;
+	unsigned int padding = (data[2] >> 1) & 1;
+
+	// Layer III only, free format bitrates cannot be sized from the header
+	if (version == 1 || layer != 1 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3)
+		return false;
+
+	bool mpeg1 = (version == 3);
+	unsigned long bitrate = s_bitrates[mpeg1 ? 0 : 1][bitrateIndex] * 1000ul;
+	header.sampleRate = s_sampleRates[version][rateIndex];
+	header.samples = mpeg1 ? 1152 : 576;
+	header.channels = ((data[3] >> 6) == 3) ? 1 : 2;
+	header.size = (mpeg1 ? 144 : 72) * bitrate / header.sampleRate + padding;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool MP3Stream::isFrameAt(unsigned long offset) const
+{
+	// A header is only believed when another one (or the end of the file)
+	// follows the frame it describes
+	FrameHeader header;
+	unsigned long size = m_file->getSize();
+	if (!parseHeader(m_file->getData() + offset, size - offset, header))
+		return false;
+
+	unsigned long next = offset + header.size;
+	FrameHeader following;
+	return next == size || (next < size && parseHeader(m_file->getData() + next, size - next, following));
+}
+
+// ----------------------------------------------------------------------------
+void MP3Stream::scan()
+{
+	const unsigned char* data = m_file->getData();
+	unsigned long size = m_file->getSize();
+	unsigned long pos = 0;
+
+	// ID3v2 tag, the size is syncsafe and excludes the 10 byte header
+	if (size >= 10 && memcmp(data, "ID3", 3) == 0)
+	{
+		pos = 10 + ((data[6] & 0x7f) << 21 | (data[7] & 0x7f) << 14 | (data[8] & 0x7f) << 7 | (data[9] & 0x7f));
+		if (data[5] & 0x10)
+		{
+			pos += 10;	// Footer
+		}
+	}
+
+	// Frame to frame, resynchronizing on anything that is not a header.
+	// All frames have to match the first one in rate and channels.
+	while (pos + 4 <= size)
+	{
+		FrameHeader header;
+		bool valid = parseHeader(data + pos, size - pos, header) && pos + header.size <= size &&
+					 (m_frames.empty() ? isFrameAt(pos) : header.sampleRate == m_sampleRate && header.channels == m_channels);
+		if (!valid)
+		{
+			const unsigned char* next = static_cast<const unsigned char*>(memchr(data + pos + 1, 0xff, size - pos - 1));
+			if (next == NULL)
+				break;
+
+			pos = next - data;
+			continue;
+		}
+
+		if (m_frames.empty())
+		{
+			m_sampleRate = header.sampleRate;
+			m_channels = header.channels;
+			m_samplesPerFrame = header.samples;
+		}
+
+		Frame frame;
+		frame.offset = pos;
+		frame.size = header.size;
+		m_frames.push_back(frame);
+		pos += header.size;
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool MP3Stream::open(const std::wstring& filename)
+{
+	close();
+
+	m_file.reset(new MappedFile());
+	if (!m_file->open(filename))
+	{
+		close();
+		return false;
+	}
+
+	scan();
+	if (m_frames.empty())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void MP3Stream::close()
+{
+	m_file.reset();
+	m_frames.clear();
+	m_sampleRate = 0;
+	m_channels = 0;
+	m_samplesPerFrame = 0;
+	rewind();
+}
+
+// ----------------------------------------------------------------------------
+void MP3Stream::rewind()
+{
+	m_nextFrame = 0;
+	m_emittedSamples = 0;
+	m_blockIndex = 0;
+}
+
+// ----------------------------------------------------------------------------
+bool MP3Stream::nextBlock(unsigned int frameRate, Block& block)
+{
+	block = Block();
+	if (isFinished() || frameRate == 0)
+		return false;
+
+	// SWF frame n starts at sample n * rate / fps. The block carries the frames
+	// needed to get past the end of this SWF frame.
+	unsigned long long rate = static_cast<unsigned long long>(m_sampleRate) << 8;
+	unsigned long long frameStart = m_blockIndex * rate / frameRate;
+	unsigned long long frameEnd = (m_blockIndex + 1) * rate / frameRate;
+	++m_blockIndex;
+
+	long long seek = static_cast<long long>(frameStart) - static_cast<long long>(m_emittedSamples);
+	block.seekSamples = static_cast<short>(std::max<long long>(-32768, std::min<long long>(32767, seek)));
+
+	const unsigned char* data = m_file->getData();
+	unsigned long samples = 0;
+	while (m_emittedSamples < frameEnd && !isFinished())
+	{
+		const Frame& frame = m_frames[m_nextFrame++];
+		const DataSpan* last = block.runs.empty() ? NULL : &block.runs.back();
+		if (last && last->data + last->size == data + frame.offset)
+		{
+			block.runs.back().size += frame.size;
+		}
+		else
+		{
+			block.runs.push_back(DataSpan(data + frame.offset, frame.size, true));
+		}
+		block.size += frame.size;
+		samples += m_samplesPerFrame;
+		m_emittedSamples += m_samplesPerFrame;
+	}
+
+	block.sampleCount = static_cast<unsigned short>(std::min(samples, 0xfffful));
+	return true;
+}
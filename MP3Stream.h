@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "DataSpan.h"
+#include "MappedFile.h"
+
+// ----------------------------------------------------------------------------
+// MPEG Layer III file split into SoundStreamBlocks, one per SWF frame. The
+// file is mapped and its frame headers are scanned once on open, the blocks
+// then reference the frames in place.
+class MP3Stream
+{
+public:
+	// Audio of one SWF frame, runs of whole MP3 frames in file order
+	struct Block
+	{
+		unsigned short sampleCount;
+		short seekSamples;			// Start of the SWF frame relative to the first sample of the block
+		DataSpanList runs;
+		unsigned long size;
+
+		Block() : sampleCount(0), seekSamples(0), size(0) {}
+	};
+
+private:
+	struct Frame
+	{
+		unsigned long offset;
+		unsigned long size;
+	};
+
+	struct FrameHeader
+	{
+		unsigned long size;
+		unsigned int sampleRate;
+		unsigned int samples;
+		unsigned int channels;
+	};
+
+private:
+	MappedFilePtr m_file;
+	std::vector<Frame> m_frames;
+	unsigned int m_sampleRate;
+	unsigned int m_channels;
+	unsigned int m_samplesPerFrame;
+
+	// Position of the next block
+	unsigned long m_nextFrame;
+	unsigned long long m_emittedSamples;
+	unsigned long m_blockIndex;
+
+private:
+	static bool parseHeader(const unsigned char* data, unsigned long available, FrameHeader& header);
+	bool isFrameAt(unsigned long offset) const;
+	void scan();
+
+public:
+	MP3Stream();
+
+	bool open(const std::wstring& filename);
+	void close();
+	void rewind();
+
+	inline const MappedFilePtr& getFile() const { return m_file; }
+	inline unsigned int getSampleRate() const { return m_sampleRate; }
+	inline unsigned int getChannels() const { return m_channels; }
+	inline unsigned int getSamplesPerFrame() const { return m_samplesPerFrame; }
+	inline unsigned long getFrameCount() const { return m_frames.size(); }
+	inline unsigned long long getSampleCount() const { return static_cast<unsigned long long>(m_frames.size()) * m_samplesPerFrame; }
+	inline bool isFinished() const { return m_nextFrame >= m_frames.size(); }
+
+	// Frames due by the end of the next SWF frame, frameRate is 8.8 fixed point.
+	// The block is empty when the previous one already covered it, false once
+	// the stream is exhausted.
+	bool nextBlock(unsigned int frameRate, Block& block);
+};
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MappedFile.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#ifndef _WIN32
+// ----------------------------------------------------------------------------
+static bool toNativePath(const std::wstring& filename, std::string& path)
+{
+	path.assign(filename.length() * MB_CUR_MAX + 1, '\0');
+	size_t pathLength = wcstombs(&path[0], filename.c_str(), path.size());
+	if (pathLength == static_cast<size_t>(-1))
+		return false;
+
+	path.resize(pathLength);
+	return true;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+MappedFile::MappedFile() :
+	m_data(NULL),
+	m_size(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE),
+	m_mapping(NULL)
+#endif
+{
+}
+
+// ----------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// ----------------------------------------------------------------------------
+bool MappedFile::open(const std::wstring& filename)
+{
+	close();
+
+#ifdef _WIN32
+	m_file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(m_file, &fileSize) && fileSize.QuadPart > 0 && fileSize.HighPart == 0)
+		{
+			m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (m_mapping)
+			{
+				m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+				m_size = fileSize.LowPart;
+			}
+		}
+	}
+#else
+	std::string path;
+	if (toNativePath(filename, path))
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd >= 0)
+		{
+			struct stat info;
+			if (fstat(fd, &info) == 0 && info.st_size > 0)
+			{
+				void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED)
+				{
+					m_data = static_cast<const unsigned char*>(data);
+					m_size = info.st_size;
+				}
+			}
+			// The mapping keeps its own reference to the file
+			::close(fd);
+		}
+	}
+#endif
+
+	if (m_data == NULL)
+	{
+		close();
+		return readFile(filename);
+	}
+
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+FILE* MappedFile::openFile(const std::wstring& filename, const char* mode)
+{
+	// fopen() by wide path, which only Windows has natively
+#ifdef _WIN32
+	std::wstring wideMode(mode, mode + strlen(mode));
+	return _wfopen(filename.c_str(), wideMode.c_str());
+#else
+	std::string path;
+	return toNativePath(filename, path) ? fopen(path.c_str(), mode) : NULL;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+bool MappedFile::readFile(const std::wstring& filename)
+{
+	FILE* fp = openFile(filename, "rb");
+	if (fp == NULL)
+		return false;
+
+	long fileSize = 0;
+	if (fseek(fp, 0, SEEK_END) == 0)
+	{
+		fileSize = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+	}
+
+	if (fileSize > 0)
+	{
+		m_fallback.resize(fileSize);
+		if (fread(&m_fallback[0], 1, fileSize, fp) == static_cast<size_t>(fileSize))
+		{
+			m_data = &m_fallback[0];
+			m_size = fileSize;
+		}
+	}
+	fclose(fp);
+
+	return m_data != NULL;
+}
+
+// ----------------------------------------------------------------------------
+void MappedFile::close()
+{
+	if (m_data && m_fallback.empty())
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+	}
+
+#ifdef _WIN32
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#endif
+
+	m_fallback.clear();
+	m_data = NULL;
+	m_size = 0;
+}
+
+// ----------------------------------------------------------------------------
+void MappedFile::prefetch() const
+{
+	// Touch every page, so that a mapped file is read now and on this thread
+	// rather than whenever its data is first used
+	volatile unsigned char sink = 0;
+	for (unsigned long i = 0; i < m_size; i += 4096)
+	{
+		sink += m_data[i];
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool MappedFile::getFileInfo(const std::wstring& filename, unsigned long& size, long long& modifiedTime)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(filename.c_str(), GetFileExInfoStandard, &attributes) || attributes.nFileSizeHigh != 0)
+		return false;
+
+	size = attributes.nFileSizeLow;
+	modifiedTime = (static_cast<long long>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+#else
+	std::string path;
+	struct stat info;
+	if (!toNativePath(filename, path) || stat(path.c_str(), &info) != 0)
+		return false;
+
+	size = info.st_size;
+#ifdef __APPLE__
+	modifiedTime = static_cast<long long>(info.st_mtimespec.tv_sec) * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+	modifiedTime = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+	return true;
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <memory>
+
+// ----------------------------------------------------------------------------
+// Read-only view of a whole file. The file is memory mapped where possible and
+// read into memory otherwise, either way the contents stay valid until close().
+class MappedFile
+{
+private:
+	const unsigned char* m_data;
+	unsigned long m_size;
+	std::vector<unsigned char> m_fallback;
+
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	bool readFile(const std::wstring& filename);
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::wstring& filename);
+	void close();
+
+	inline const unsigned char* getData() const { return m_data; }
+	inline unsigned long getSize() const { return m_size; }
+	void prefetch() const;
+
+	static FILE* openFile(const std::wstring& filename, const char* mode);
+	static bool getFileInfo(const std::wstring& filename, unsigned long& size, long long& modifiedTime);
+};
+
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
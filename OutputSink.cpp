@@ -0,0 +1,380 @@
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "OutputSink.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+// ----------------------------------------------------------------------------
+unsigned long OutputSink::File::getSize() const
+{
+	unsigned long size = prefixSize;
+	for (DataSpanList::const_iterator i = spans.begin(); i != spans.end(); ++i)
+	{
+		size += i->size;
+	}
+	return size;
+}
+
+// ----------------------------------------------------------------------------
+FileSink::FileSink(const std::wstring& filename) :
+	m_filename(filename),
+	m_file(NULL),
+	m_resumed(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+FileSink::~FileSink()
+{
+	endStream();
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::writeFile(File& file)
+{
+	FILE *fp = MappedFile::openFile(m_filename, "wb");
+	if (fp == NULL)
+		return false;
+
+	bool success = fwrite(file.prefix, 1, file.prefixSize, fp) == file.prefixSize;
+	for (DataSpanList::const_iterator i = file.spans.begin(); i != file.spans.end() && success; ++i)
+	{
+		success = fwrite(i->data, 1, i->size, fp) == i->size;
+	}
+	fclose(fp);
+
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::beginStream()
+{
+	// Content goes out as it is completed, so the file has to exist up front.
+	m_file = MappedFile::openFile(m_filename, "wb");
+	m_resumed = false;
+	return m_file != NULL;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::resumeStream(unsigned long pos)
+{
+	// Streams into an existing file from pos on, the bytes before it stay and
+	// can still be patched
+	m_file = MappedFile::openFile(m_filename, "r+b");
+	if (m_file == NULL)
+		return false;
+
+	if (fseek(m_file, pos, SEEK_SET) != 0)
+	{
+		fclose(m_file);
+		m_file = NULL;
+		return false;
+	}
+	m_resumed = true;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::writeStream(const unsigned char* data, unsigned long size)
+{
+	return m_file && fwrite(data, 1, size, m_file) == size;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::patchStream(unsigned long pos, const unsigned char* data, unsigned long size)
+{
+	if (m_file == NULL)
+		return false;
+
+	long currPos = ftell(m_file);
+	bool success = fseek(m_file, pos, SEEK_SET) == 0 && 
+				   fwrite(data, 1, size, m_file) == size;
+	fseek(m_file, currPos, SEEK_SET);
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::flushStream()
+{
+	return m_file && fflush(m_file) == 0;
+}
+
+// ----------------------------------------------------------------------------
+bool FileSink::endStream()
+{
+	if (m_file == NULL)
+		return false;
+
+	bool success = true;
+	if (m_resumed)
+	{
+		// The new end may come before the old one
+		long size = ftell(m_file);
+		success = fflush(m_file) == 0 && size >= 0;
+#ifdef _WIN32
+		success = success && _chsize_s(_fileno(m_file), size) == 0;
+#else
+		success = success && ftruncate(fileno(m_file), size) == 0;
+#endif
+		m_resumed = false;
+	}
+	success = fclose(m_file) == 0 && success;
+	m_file = NULL;
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+DescriptorSink::DescriptorSink(int fd) :
+	m_fd(fd),
+	m_streamStart(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::writeAll(const unsigned char* data, unsigned long size)
+{
+	while (size > 0)
+	{
+#ifdef _WIN32
+		int count = _write(m_fd, data, std::min(size, 1ul << 30));
+#else
+		ssize_t count = ::write(m_fd, data, size);
+		if (count < 0 && errno == EINTR)
+			continue;
+#endif
+		if (count <= 0)
+			return false;
+
+		data += count;
+		size -= count;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::writeFile(File& file)
+{
+	bool success = writeAll(file.prefix, file.prefixSize);
+	for (DataSpanList::const_iterator i = file.spans.begin(); i != file.spans.end() && success; ++i)
+	{
+		success = writeAll(i->data, i->size);
+	}
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::beginStream()
+{
+	// Patch positions are relative to where the stream starts
+#ifdef _WIN32
+	long long pos = _lseeki64(m_fd, 0, SEEK_CUR);
+#else
+	long long pos = lseek(m_fd, 0, SEEK_CUR);
+#endif
+	m_streamStart = pos >= 0 ? pos : ~0ull;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::writeStream(const unsigned char* data, unsigned long size)
+{
+	return writeAll(data, size);
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::patchStream(unsigned long pos, const unsigned char* data, unsigned long size)
+{
+	if (m_streamStart == ~0ull)
+		return false;
+
+#ifdef _WIN32
+	long long currPos = _lseeki64(m_fd, 0, SEEK_CUR);
+	bool success = _lseeki64(m_fd, m_streamStart + pos, SEEK_SET) >= 0 && writeAll(data, size);
+	_lseeki64(m_fd, currPos, SEEK_SET);
+	return success;
+#else
+	while (size > 0)
+	{
+		ssize_t count = pwrite(m_fd, data, size, m_streamStart + pos);
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count <= 0)
+			return false;
+
+		data += count;
+		pos += count;
+		size -= count;
+	}
+	return true;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+bool DescriptorSink::endStream()
+{
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+CallbackSink::CallbackSink(const Callback& callback) :
+	m_callback(callback)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool CallbackSink::writeFile(File& file)
+{
+	bool success = file.prefixSize == 0 || m_callback(file.prefix, file.prefixSize);
+	for (DataSpanList::const_iterator i = file.spans.begin(); i != file.spans.end() && success; ++i)
+	{
+		success = m_callback(i->data, i->size);
+	}
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool CallbackSink::beginStream()
+{
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool CallbackSink::writeStream(const unsigned char* data, unsigned long size)
+{
+	return m_callback(data, size);
+}
+
+// ----------------------------------------------------------------------------
+bool CallbackSink::patchStream(unsigned long /*pos*/, const unsigned char* /*data*/, unsigned long /*size*/)
+{
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+bool CallbackSink::endStream()
+{
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+MemoryOutput::MemoryOutput()
+{
+}
+
+// ----------------------------------------------------------------------------
+unsigned long MemoryOutput::getSize() const
+{
+	unsigned long size = 0;
+	for (DataSpanList::const_iterator i = m_spans.begin(); i != m_spans.end(); ++i)
+	{
+		size += i->size;
+	}
+	return size;
+}
+
+// ----------------------------------------------------------------------------
+void MemoryOutput::copyTo(std::vector<unsigned char>& data) const
+{
+	data.clear();
+	data.reserve(getSize());
+	for (DataSpanList::const_iterator i = m_spans.begin(); i != m_spans.end(); ++i)
+	{
+		data.insert(data.end(), i->data, i->data + i->size);
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool MemorySink::writeFile(File& file)
+{
+	std::unique_ptr<MemoryOutput> output(new MemoryOutput());
+	if (file.prefixSize > 0)
+	{
+		memcpy(output->m_prefix, file.prefix, file.prefixSize);
+		output->m_spans.push_back(DataSpan(output->m_prefix, file.prefixSize));
+	}
+
+	if (file.buffer || file.data)
+	{
+		// The storage changes hands with the swap, the spans stay valid
+		if (file.buffer)
+		{
+			output->m_buffer.swap(*file.buffer);
+		}
+		if (file.data)
+		{
+			output->m_data.swap(*file.data);
+		}
+		output->m_spans.insert(output->m_spans.end(), file.spans.begin(), file.spans.end());
+	}
+	else
+	{
+		for (DataSpanList::const_iterator i = file.spans.begin(); i != file.spans.end(); ++i)
+		{
+			output->m_data.insert(output->m_data.end(), i->data, i->data + i->size);
+		}
+		if (!output->m_data.empty())
+		{
+			output->m_spans.push_back(DataSpan(&output->m_data[0], output->m_data.size()));
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_output = std::move(output);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool MemorySink::beginStream()
+{
+	m_stream.reset(new MemoryOutput());
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool MemorySink::writeStream(const unsigned char* data, unsigned long size)
+{
+	if (!m_stream)
+		return false;
+
+	m_stream->m_data.insert(m_stream->m_data.end(), data, data + size);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool MemorySink::patchStream(unsigned long pos, const unsigned char* data, unsigned long size)
+{
+	if (!m_stream || pos + size > m_stream->m_data.size())
+		return false;
+
+	memcpy(&m_stream->m_data[pos], data, size);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool MemorySink::endStream()
+{
+	if (!m_stream)
+		return false;
+
+	if (!m_stream->m_data.empty())
+	{
+		m_stream->m_spans.push_back(DataSpan(&m_stream->m_data[0], m_stream->m_data.size()));
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_output = std::move(m_stream);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+std::unique_ptr<MemoryOutput> MemorySink::takeOutput()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return std::move(m_output);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "DataSpan.h"
+#include "SegmentedBuffer.h"
+
+// ----------------------------------------------------------------------------
+// Destination of a written file. A file finished in memory is handed over in
+// one writeFile() call, a streamed one arrives through beginStream(),
+// writeStream() and patchStream() as it is produced.
+class OutputSink
+{
+public:
+	// Finished file: a small prefix followed by the spans. The spans point
+	// into buffer or data when those are set, and a sink may take them over
+	// instead of copying.
+	struct File
+	{
+		unsigned char prefix[12];
+		unsigned long prefixSize;
+		DataSpanList spans;
+		SegmentedBuffer* buffer;
+		std::vector<unsigned char>* data;
+
+		File() : prefixSize(0), buffer(NULL), data(NULL) {}
+		unsigned long getSize() const;
+	};
+
+public:
+	virtual ~OutputSink() {}
+
+	virtual bool writeFile(File& file) = 0;
+
+	virtual bool beginStream() = 0;
+	virtual bool writeStream(const unsigned char* data, unsigned long size) = 0;
+	virtual bool patchStream(unsigned long pos, const unsigned char* data, unsigned long size) = 0;	// Already written bytes
+	virtual bool flushStream() { return true; }	// Pushes out what the sink itself buffers
+	virtual bool endStream() = 0;
+};
+
+// ----------------------------------------------------------------------------
+// Named file on disk
+class FileSink : public OutputSink
+{
+private:
+	std::wstring m_filename;
+	FILE* m_file;
+	bool m_resumed;		// The stream ends the file, whatever was there after it is cut off
+
+public:
+	explicit FileSink(const std::wstring& filename);
+	virtual ~FileSink();
+
+	virtual bool writeFile(File& file);
+	virtual bool beginStream();
+	bool resumeStream(unsigned long pos);
+	virtual bool writeStream(const unsigned char* data, unsigned long size);
+	virtual bool patchStream(unsigned long pos, const unsigned char* data, unsigned long size);
+	virtual bool flushStream();
+	virtual bool endStream();
+};
+
+// ----------------------------------------------------------------------------
+// Open file descriptor (socket, pipe, file) owned by the caller. Streamed
+// output can only be patched if the descriptor is seekable.
+class DescriptorSink : public OutputSink
+{
+private:
+	int m_fd;
+	unsigned long long m_streamStart;
+
+	bool writeAll(const unsigned char* data, unsigned long size);
+
+public:
+	explicit DescriptorSink(int fd);
+
+	virtual bool writeFile(File& file);
+	virtual bool beginStream();
+	virtual bool writeStream(const unsigned char* data, unsigned long size);
+	virtual bool patchStream(unsigned long pos, const unsigned char* data, unsigned long size);
+	virtual bool endStream();
+};
+
+// ----------------------------------------------------------------------------
+// Hands every piece of output to a function, in file order. Streamed output
+// cannot be patched.
+class CallbackSink : public OutputSink
+{
+public:
+	typedef std::function<bool(const unsigned char* data, unsigned long size)> Callback;
+
+private:
+	Callback m_callback;
+
+public:
+	explicit CallbackSink(const Callback& callback);
+
+	virtual bool writeFile(File& file);
+	virtual bool beginStream();
+	virtual bool writeStream(const unsigned char* data, unsigned long size);
+	virtual bool patchStream(unsigned long pos, const unsigned char* data, unsigned long size);
+	virtual bool endStream();
+};
+
+// ----------------------------------------------------------------------------
+// File kept in memory. Owns the buffers of the writer that produced it, the
+// spans stay valid for the lifetime of the object.
+class MemoryOutput
+{
+	friend class MemorySink;
+
+private:
+	unsigned char m_prefix[12];
+	SegmentedBuffer m_buffer;
+	std::vector<unsigned char> m_data;
+	DataSpanList m_spans;
+
+private:
+	MemoryOutput(const MemoryOutput&);
+	MemoryOutput& operator=(const MemoryOutput&);
+
+public:
+	MemoryOutput();
+
+	inline const DataSpanList& getSpans() const { return m_spans; }
+	unsigned long getSize() const;
+	void copyTo(std::vector<unsigned char>& data) const;
+};
+
+// ----------------------------------------------------------------------------
+// Collects the file in memory. A file finished in memory is taken over from
+// the writer without copying, streamed output is appended to one buffer.
+class MemorySink : public OutputSink
+{
+private:
+	std::unique_ptr<MemoryOutput> m_output;
+	std::unique_ptr<MemoryOutput> m_stream;
+	std::mutex m_mutex;
+
+public:
+	virtual bool writeFile(File& file);
+	virtual bool beginStream();
+	virtual bool writeStream(const unsigned char* data, unsigned long size);
+	virtual bool patchStream(unsigned long pos, const unsigned char* data, unsigned long size);
+	virtual bool endStream();
+
+	// NULL until the writer has closed the file (and its close result is ready)
+	std::unique_ptr<MemoryOutput> takeOutput();
+};
@@ -0,0 +1,313 @@
+#include <string.h>
+#include "PixelConvert.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SWF_PIXEL_AVX2
+#define SWF_PIXEL_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SWF_PIXEL_SSE2
+#endif
+
+// ----------------------------------------------------------------------------
+// (value + 127) / 255 for value <= 255 * 255, without the division
+static inline unsigned int divide255(unsigned int value)
+{
+	value += 128;
+	return (value + (value >> 8)) >> 8;
+}
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format, AlphaMode alpha>
+static void convertRowScalar(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+		unsigned int r = src[format == PixelFormat_RGBA ? 0 : 2];
+		unsigned int g = src[1];
+		unsigned int b = src[format == PixelFormat_RGBA ? 2 : 0];
+		unsigned int a = src[3];
+		if (alpha == Alpha_Premultiply)
+		{
+			r = divide255(r * a);
+			g = divide255(g * a);
+			b = divide255(b * a);
+		}
+		else if (alpha == Alpha_Opaque)
+		{
+			a = 0;
+		}
+		dst[0] = static_cast<unsigned char>(a);
+		dst[1] = static_cast<unsigned char>(r);
+		dst[2] = static_cast<unsigned char>(g);
+		dst[3] = static_cast<unsigned char>(b);
+	}
+}
+
+#ifdef SWF_PIXEL_SSE2
+// ----------------------------------------------------------------------------
+// Two pixels as 16-bit channels reordered to ARGB. The 16-bit shuffles keep
+// this within SSE2, no byte shuffle is needed.
+template <PixelFormat format>
+static inline __m128i reorder(__m128i channels)
+{
+	// RGBA -> lanes 3 0 1 2, BGRA -> lanes 3 2 1 0
+	const int order = (format == PixelFormat_RGBA) ? _MM_SHUFFLE(2, 1, 0, 3) : _MM_SHUFFLE(0, 1, 2, 3);
+	channels = _mm_shufflelo_epi16(channels, order);
+	return _mm_shufflehi_epi16(channels, order);
+}
+
+// ----------------------------------------------------------------------------
+template <AlphaMode alpha>
+static inline __m128i applyAlpha(__m128i argb)
+{
+	const __m128i colorMask = _mm_set_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+	if (alpha == Alpha_Opaque)
+		return _mm_and_si128(argb, colorMask);
+	if (alpha == Alpha_Premultiplied)
+		return argb;
+
+	// Alpha multiplies the colors and 255 the alpha itself
+	__m128i factor = _mm_shufflehi_epi16(_mm_shufflelo_epi16(argb, 0), 0);
+	factor = _mm_or_si128(_mm_and_si128(factor, colorMask), _mm_set_epi16(0, 0, 0, 255, 0, 0, 0, 255));
+	__m128i value = _mm_add_epi16(_mm_mullo_epi16(argb, factor), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format, AlphaMode alpha>
+static unsigned int convertRowSSE2(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4, src += 16, dst += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+		__m128i low = applyAlpha<alpha>(reorder<format>(_mm_unpacklo_epi8(pixels, zero)));
+		__m128i high = applyAlpha<alpha>(reorder<format>(_mm_unpackhi_epi8(pixels, zero)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(low, high));
+	}
+	return i;
+}
+#endif
+
+#ifdef SWF_PIXEL_AVX2
+// ----------------------------------------------------------------------------
+// Same as the SSE2 version on both 128-bit lanes. Unpack, shuffle and pack all
+// work per lane, so the pixel order comes out unchanged.
+template <PixelFormat format>
+static inline __m256i reorder(__m256i channels)
+{
+	const int order = (format == PixelFormat_RGBA) ? _MM_SHUFFLE(2, 1, 0, 3) : _MM_SHUFFLE(0, 1, 2, 3);
+	channels = _mm256_shufflelo_epi16(channels, order);
+	return _mm256_shufflehi_epi16(channels, order);
+}
+
+// ----------------------------------------------------------------------------
+template <AlphaMode alpha>
+static inline __m256i applyAlpha(__m256i argb)
+{
+	const __m256i colorMask = _mm256_set_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+	if (alpha == Alpha_Opaque)
+		return _mm256_and_si256(argb, colorMask);
+	if (alpha == Alpha_Premultiplied)
+		return argb;
+
+	__m256i factor = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(argb, 0), 0);
+	factor = _mm256_or_si256(_mm256_and_si256(factor, colorMask),
+							 _mm256_set_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255));
+	__m256i value = _mm256_add_epi16(_mm256_mullo_epi16(argb, factor), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format, AlphaMode alpha>
+static unsigned int convertRowAVX2(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8, src += 32, dst += 32)
+	{
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+		__m256i low = applyAlpha<alpha>(reorder<format>(_mm256_unpacklo_epi8(pixels, zero)));
+		__m256i high = applyAlpha<alpha>(reorder<format>(_mm256_unpackhi_epi8(pixels, zero)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_packus_epi16(low, high));
+	}
+	return i;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format, AlphaMode alpha>
+static void convertRows(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, unsigned char* argb)
+{
+	for (unsigned int y = 0; y < height; ++y, pixels += stride, argb += width * 4)
+	{
+		// The widest kernel first, the rest of the row goes to the narrower ones
+		unsigned int done = 0;
+#ifdef SWF_PIXEL_AVX2
+		done += convertRowAVX2<format, alpha>(pixels, argb, width);
+#endif
+#ifdef SWF_PIXEL_SSE2
+		done += convertRowSSE2<format, alpha>(pixels + done * 4, argb + done * 4, width - done);
+#endif
+		convertRowScalar<format, alpha>(pixels + done * 4, argb + done * 4, width - done);
+	}
+}
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format>
+static void convertRows(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, AlphaMode alpha, unsigned char* argb)
+{
+	switch (alpha)
+	{
+	case Alpha_Premultiply:		convertRows<format, Alpha_Premultiply>(pixels, width, height, stride, argb);	break;
+	case Alpha_Premultiplied:	convertRows<format, Alpha_Premultiplied>(pixels, width, height, stride, argb);	break;
+	case Alpha_Opaque:			convertRows<format, Alpha_Opaque>(pixels, width, height, stride, argb);			break;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void convertToARGB(const unsigned char* pixels, unsigned int width, unsigned int height, long stride,
+				   PixelFormat format, AlphaMode alpha, unsigned char* argb)
+{
+	if (format == PixelFormat_RGBA)
+	{
+		convertRows<PixelFormat_RGBA>(pixels, width, height, stride, alpha, argb);
+	}
+	else
+	{
+		convertRows<PixelFormat_BGRA>(pixels, width, height, stride, alpha, argb);
+	}
+}
+
+// ----------------------------------------------------------------------------
+static void extractAlphaScalar(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		dst[i] = src[i * 4 + 3];
+	}
+}
+
+#ifdef SWF_PIXEL_SSE2
+// ----------------------------------------------------------------------------
+static unsigned int extractAlphaSSE2(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	const __m128i* pixels = reinterpret_cast<const __m128i*>(src);
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16, pixels += 4)
+	{
+		__m128i a0 = _mm_srli_epi32(_mm_loadu_si128(pixels), 24);
+		__m128i a1 = _mm_srli_epi32(_mm_loadu_si128(pixels + 1), 24);
+		__m128i a2 = _mm_srli_epi32(_mm_loadu_si128(pixels + 2), 24);
+		__m128i a3 = _mm_srli_epi32(_mm_loadu_si128(pixels + 3), 24);
+		__m128i alpha = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), alpha);
+	}
+	return i;
+}
+#endif
+
+#ifdef SWF_PIXEL_AVX2
+// ----------------------------------------------------------------------------
+static unsigned int extractAlphaAVX2(const unsigned char* src, unsigned char* dst, unsigned int count)
+{
+	// The packs interleave the 128-bit lanes, the permute puts the groups of
+	// four pixels back in order
+	const __m256i order = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
+	const __m256i* pixels = reinterpret_cast<const __m256i*>(src);
+	unsigned int i = 0;
+	for (; i + 32 <= count; i += 32, pixels += 4)
+	{
+		__m256i a0 = _mm256_srli_epi32(_mm256_loadu_si256(pixels), 24);
+		__m256i a1 = _mm256_srli_epi32(_mm256_loadu_si256(pixels + 1), 24);
+		__m256i a2 = _mm256_srli_epi32(_mm256_loadu_si256(pixels + 2), 24);
+		__m256i a3 = _mm256_srli_epi32(_mm256_loadu_si256(pixels + 3), 24);
+		__m256i alpha = _mm256_packus_epi16(_mm256_packs_epi32(a0, a1), _mm256_packs_epi32(a2, a3));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(alpha, order));
+	}
+	return i;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+void extractAlpha(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, unsigned char* alpha)
+{
+	for (unsigned int y = 0; y < height; ++y, pixels += stride, alpha += width)
+	{
+		unsigned int done = 0;
+#ifdef SWF_PIXEL_AVX2
+		done += extractAlphaAVX2(pixels, alpha, width);
+#endif
+#ifdef SWF_PIXEL_SSE2
+		done += extractAlphaSSE2(pixels + done * 4, alpha + done, width - done);
+#endif
+		extractAlphaScalar(pixels + done * 4, alpha + done, width - done);
+	}
+}
+
+// ----------------------------------------------------------------------------
+template <PixelFormat format>
+static void convertRowsToBGR(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, unsigned char* bgr)
+{
+	// Only done for blocks that changed, the 3 byte pixels are left scalar
+	for (unsigned int y = 0; y < height; ++y, pixels += stride)
+	{
+		const unsigned char* src = pixels;
+		for (unsigned int x = 0; x < width; ++x, src += 4, bgr += 3)
+		{
+			bgr[0] = src[format == PixelFormat_RGBA ? 2 : 0];
+			bgr[1] = src[1];
+			bgr[2] = src[format == PixelFormat_RGBA ? 0 : 2];
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void convertToBGR(const unsigned char* pixels, unsigned int width, unsigned int height, long stride,
+				  PixelFormat format, unsigned char* bgr)
+{
+	if (format == PixelFormat_RGBA)
+	{
+		convertRowsToBGR<PixelFormat_RGBA>(pixels, width, height, stride, bgr);
+	}
+	else
+	{
+		convertRowsToBGR<PixelFormat_BGRA>(pixels, width, height, stride, bgr);
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool equalPixels(const unsigned char* first, const unsigned char* second, unsigned int count)
+{
+	unsigned int i = 0;
+#ifdef SWF_PIXEL_AVX2
+	const __m256i colorMask256 = _mm256_set1_epi32(0x00ffffff);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i * 4));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + i * 4));
+		if (!_mm256_testz_si256(_mm256_xor_si256(a, b), colorMask256))
+			return false;
+	}
+#endif
+#ifdef SWF_PIXEL_SSE2
+	const __m128i colorMask = _mm_set1_epi32(0x00ffffff);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i * 4));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i * 4));
+		__m128i diff = _mm_and_si128(_mm_xor_si128(a, b), colorMask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xffff)
+			return false;
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if (memcmp(first + i * 4, second + i * 4, 3) != 0)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// ----------------------------------------------------------------------------
+// Byte order of 32-bit source pixels in memory
+enum PixelFormat
+{
+	PixelFormat_RGBA,
+	PixelFormat_BGRA
+};
+
+// ----------------------------------------------------------------------------
+// What the conversion does with the alpha channel
+enum AlphaMode
+{
+	Alpha_Premultiply,		///< Straight alpha, the colors get multiplied by it.
+	Alpha_Premultiplied,	///< The colors are already multiplied by alpha.
+	Alpha_Opaque			///< No alpha, the byte is written as 0 (PIX24 reserved).
+};
+
+// ----------------------------------------------------------------------------
+// Converts rows of 32-bit pixels, stride bytes apart, to the packed ARGB rows
+// of DefineBitsLossless(2) bitmap data. Uses AVX2 or SSE2 when the build
+// targets them, scalar code otherwise.
+void convertToARGB(const unsigned char* pixels, unsigned int width, unsigned int height, long stride,
+				   PixelFormat format, AlphaMode alpha, unsigned char* argb);
+
+// ----------------------------------------------------------------------------
+// Copies the alpha byte of rows of 32-bit pixels (RGBA or BGRA) to a packed
+// 8-bit plane, as DefineBitsJPEG3 stores it.
+void extractAlpha(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, unsigned char* alpha);
+
+// ----------------------------------------------------------------------------
+// Converts rows of 32-bit pixels to packed 24-bit BGR rows, as Screen Video
+// blocks store them.
+void convertToBGR(const unsigned char* pixels, unsigned int width, unsigned int height, long stride,
+				  PixelFormat format, unsigned char* bgr);
+
+// ----------------------------------------------------------------------------
+// True when count 32-bit pixels have the same color, the alpha byte is ignored
+bool equalPixels(const unsigned char* first, const unsigned char* second, unsigned int count);
@@ -0,0 +1,178 @@
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "zlib.h"
+#include "ScreenVideo.h"
+#include "ThreadPool.h"
+
+// ----------------------------------------------------------------------------
+ScreenVideoEncoder::ScreenVideoEncoder() :
+	m_width(0),
+	m_height(0),
+	m_blockWidth(16),
+	m_blockHeight(16),
+	m_keyFrameInterval(0),
+	m_frameNumber(0),
+	m_keyFrame(false),
+	m_tier(Compressor::TIER_BEST),
+	m_threadPool(NULL)
+{
+}
+
+// ----------------------------------------------------------------------------
+ScreenVideoEncoder::~ScreenVideoEncoder()
+{
+}
+
+// ----------------------------------------------------------------------------
+bool ScreenVideoEncoder::begin(unsigned int width, unsigned int height, unsigned int blockWidth, unsigned int blockHeight)
+{
+	// Block sizes are multiples of 16 up to 256, the image is at most 4095 square.
+	// A block has a 16-bit size in the packet, so blocks that could deflate to
+	// more than that (about 144x144) are refused rather than failing on noisy
+	// frames.
+	if (width == 0 || height == 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE ||
+		blockWidth == 0 || blockWidth % 16 != 0 || blockWidth > MAX_BLOCK_SIZE ||
+		blockHeight == 0 || blockHeight % 16 != 0 || blockHeight > MAX_BLOCK_SIZE ||
+		compressBound(blockWidth * blockHeight * 3) > 0xffff)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_blockWidth = blockWidth;
+	m_blockHeight = blockHeight;
+	m_frameNumber = 0;
+	m_keyFrame = false;
+	m_previous.assign(width * height * 4, 0);
+	m_changed.clear();
+
+	// Rows of blocks from the bottom of the image up, a partial row at the top
+	// and a partial column on the right
+	m_blocks.clear();
+	for (unsigned int bottom = 0; bottom < height; bottom += blockHeight)
+	{
+		unsigned int rows = std::min(blockHeight, height - bottom);
+		for (unsigned int x = 0; x < width; x += blockWidth)
+		{
+			Block block;
+			block.x = x;
+			block.y = height - bottom - rows;
+			block.width = std::min(blockWidth, width - x);
+			block.height = rows;
+			m_blocks.push_back(block);
+		}
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void ScreenVideoEncoder::setThreadPool(ThreadPool* pool)
+{
+	m_threadPool = pool;
+}
+
+// ----------------------------------------------------------------------------
+void ScreenVideoEncoder::setTier(Compressor::Tier tier)
+{
+	m_tier = tier;
+	for (unsigned int i = 0; i < m_compressors.size(); ++i)
+	{
+		m_compressors[i]->setTier(tier);
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool ScreenVideoEncoder::compressBlocks(unsigned int first, unsigned int last, ZLIBCompressor& compressor)
+{
+	// A block has a 16-bit size in the packet
+	bool success = true;
+	for (unsigned int i = first; i < last; ++i)
+	{
+		Block& block = m_blocks[m_changed[i]];
+		unsigned int size = compressor.compress(&block.pixels[0], block.pixels.size(), block.data);
+		success = success && size > 0 && size <= 0xffff;
+	}
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+bool ScreenVideoEncoder::encodeFrame(const unsigned char* pixels, long stride, PixelFormat format,
+									 std::vector<unsigned char>& packet, bool keyFrame)
+{
+	if (m_blocks.empty() || pixels == NULL)
+		return false;
+
+	m_keyFrame = keyFrame || m_frameNumber == 0 || (m_keyFrameInterval > 0 && m_frameNumber % m_keyFrameInterval == 0);
+	++m_frameNumber;
+
+	// Blocks that differ from the previous frame, which is updated as they are found
+	unsigned long previousStride = m_width * 4;
+	m_changed.clear();
+	for (unsigned int i = 0; i < m_blocks.size(); ++i)
+	{
+		Block& block = m_blocks[i];
+		block.data.clear();
+
+		const unsigned char* src = pixels + static_cast<ptrdiff_t>(block.y) * stride + block.x * 4;
+		unsigned char* previous = &m_previous[block.y * previousStride + block.x * 4];
+		bool changed = m_keyFrame;
+		for (unsigned int y = 0; y < block.height && !changed; ++y)
+		{
+			changed = !equalPixels(src + static_cast<ptrdiff_t>(y) * stride, previous + y * previousStride, block.width);
+		}
+		if (!changed)
+			continue;
+
+		for (unsigned int y = 0; y < block.height; ++y)
+		{
+			memcpy(previous + y * previousStride, src + static_cast<ptrdiff_t>(y) * stride, block.width * 4);
+		}
+		block.pixels.resize(block.width * block.height * 3);
+		convertToBGR(src + static_cast<ptrdiff_t>(block.height - 1) * stride, block.width, block.height, -stride, format, &block.pixels[0]);
+		m_changed.push_back(i);
+	}
+
+	// The changed blocks are split into one contiguous range per task. Each
+	// task has its own compressor, a block compresses the same whatever the
+	// thread count.
+	unsigned int taskCount = m_threadPool ? std::max(1u, m_threadPool->getThreadCount()) : 1;
+	taskCount = std::max(1u, std::min<unsigned int>(taskCount, m_changed.size()));
+	while (m_compressors.size() < taskCount)
+	{
+		m_compressors.push_back(std::unique_ptr<ZLIBCompressor>(new ZLIBCompressor()));
+		m_compressors.back()->setTier(m_tier);
+	}
+
+	std::vector<char> results(taskCount, 1);
+	TaskGroup group(taskCount > 1 ? m_threadPool : NULL);
+	for (unsigned int t = 0; t < taskCount; ++t)
+	{
+		unsigned int first = m_changed.size() * t / taskCount;
+		unsigned int last = m_changed.size() * (t + 1) / taskCount;
+		ZLIBCompressor* compressor = m_compressors[t].get();
+		char* result = &results[t];
+		group.run([this, first, last, compressor, result]() { *result = compressBlocks(first, last, *compressor); });
+	}
+	group.wait();
+	if (std::find(results.begin(), results.end(), 0) != results.end())
+	{
+		m_frameNumber = 0;		// The previous frame is ahead of the decoder now
+		return false;
+	}
+
+	// Block sizes and image sizes in 4 + 12 bits, then the blocks with a big
+	// endian size each, 0 for an unchanged block
+	packet.clear();
+	packet.push_back(static_cast<unsigned char>(((m_blockWidth / 16 - 1) << 4) | (m_width >> 8)));
+	packet.push_back(static_cast<unsigned char>(m_width));
+	packet.push_back(static_cast<unsigned char>(((m_blockHeight / 16 - 1) << 4) | (m_height >> 8)));
+	packet.push_back(static_cast<unsigned char>(m_height));
+	for (std::vector<Block>::const_iterator i = m_blocks.begin(); i != m_blocks.end(); ++i)
+	{
+		unsigned int size = i->data.size();
+		packet.push_back(static_cast<unsigned char>(size >> 8));
+		packet.push_back(static_cast<unsigned char>(size));
+		packet.insert(packet.end(), i->data.begin(), i->data.end());
+	}
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "Compress.h"
+#include "PixelConvert.h"
+
+class ThreadPool;
+
+// ----------------------------------------------------------------------------
+// Screen Video (codec 3) encoder. Frames are split into blocks and only the
+// blocks that changed since the previous frame are deflated, each as its own
+// zlib stream. The packets go into VideoFrame tags.
+class ScreenVideoEncoder
+{
+public:
+	enum { MAX_IMAGE_SIZE = 4095, MAX_BLOCK_SIZE = 256 };
+
+private:
+	// ------------------------------------------------------------------------
+	struct Block
+	{
+		unsigned int x;
+		unsigned int y;					// Top row, counted from the top of the image
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned char> pixels;	// BGR rows, bottom up
+		std::vector<unsigned char> data;	// Compressed, empty if unchanged
+	};
+
+private:
+	unsigned int m_width;
+	unsigned int m_height;
+	unsigned int m_blockWidth;
+	unsigned int m_blockHeight;
+	unsigned int m_keyFrameInterval;
+	unsigned long m_frameNumber;
+	bool m_keyFrame;
+	Compressor::Tier m_tier;
+	ThreadPool* m_threadPool;
+	std::vector<unsigned char> m_previous;		// Last frame as 32-bit pixels, top down
+	std::vector<Block> m_blocks;				// In packet order, bottom row of blocks first
+	std::vector<unsigned int> m_changed;
+	std::vector<std::unique_ptr<ZLIBCompressor> > m_compressors;	// One per task
+
+private:
+	ScreenVideoEncoder(const ScreenVideoEncoder&);
+	ScreenVideoEncoder& operator=(const ScreenVideoEncoder&);
+
+	bool compressBlocks(unsigned int first, unsigned int last, ZLIBCompressor& compressor);
+
+public:
+	ScreenVideoEncoder();
+	~ScreenVideoEncoder();
+
+	// False for block sizes whose compressed data may not fit the 16-bit block size
+	bool begin(unsigned int width, unsigned int height, unsigned int blockWidth = 16, unsigned int blockHeight = 16);
+	void setThreadPool(ThreadPool* pool);
+	void setTier(Compressor::Tier tier);
+	inline void setKeyFrameInterval(unsigned int interval) { m_keyFrameInterval = interval; }
+
+	// Encodes the next frame of width x height pixels, rows stride bytes apart
+	bool encodeFrame(const unsigned char* pixels, long stride, PixelFormat format,
+					 std::vector<unsigned char>& packet, bool keyFrame = false);
+
+	inline unsigned int getWidth() const { return m_width; }
+	inline unsigned int getHeight() const { return m_height; }
+	inline bool isKeyFrame() const { return m_keyFrame; }
+	inline unsigned int getChangedBlockCount() const { return m_changed.size(); }
+	inline unsigned int getBlockCount() const { return m_blocks.size(); }
+};
@@ -0,0 +1,407 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "SegmentedBuffer.h"
+
+// ----------------------------------------------------------------------------
+ChunkPool::ChunkPool(unsigned int chunkSize) :
+	m_chunkSize(chunkSize),
+	m_allocationCount(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+ChunkPool::~ChunkPool()
+{
+	trim();
+}
+
+// ----------------------------------------------------------------------------
+ChunkPool& ChunkPool::getDefault()
+{
+	static ChunkPool pool;
+	return pool;
+}
+
+// ----------------------------------------------------------------------------
+unsigned char* ChunkPool::allocate()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_freeChunks.empty())
+		{
+			unsigned char* chunk = m_freeChunks.back();
+			m_freeChunks.pop_back();
+			return chunk;
+		}
+	}
+
+	++m_allocationCount;
+	return new unsigned char[m_chunkSize];
+}
+
+// ----------------------------------------------------------------------------
+void ChunkPool::release(unsigned char* chunk)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_freeChunks.push_back(chunk);
+}
+
+// ----------------------------------------------------------------------------
+void ChunkPool::trim()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (std::vector<unsigned char*>::iterator i = m_freeChunks.begin(); i != m_freeChunks.end(); ++i)
+	{
+		delete [] *i;
+	}
+	m_freeChunks.clear();
+}
+
+// ----------------------------------------------------------------------------
+SegmentedBuffer::SegmentedBuffer(ChunkPool* pool) :
+	m_pool(pool),
+	m_begin(0),
+	m_end(0),
+	m_tail(NULL),
+	m_tailFree(0),
+	m_detachedFree(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+SegmentedBuffer::~SegmentedBuffer()
+{
+	clear();
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::appendChunk()
+{
+	Segment segment;
+	segment.begin = m_end;
+
+	if (m_detachedFree > 0)
+	{
+		// Carry on in the chunk that was interrupted by external data
+		segment.data = m_tail;
+		segment.capacity = m_detachedFree;
+		m_tailFree = m_detachedFree;
+		m_detachedFree = 0;
+	}
+	else
+	{
+		segment.chunk = m_pool->allocate();
+		segment.data = segment.chunk;
+		segment.capacity = m_pool->getChunkSize();
+		m_tail = segment.chunk;
+		m_tailFree = segment.capacity;
+	}
+
+	m_segments.push_back(segment);
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::updateTail()
+{
+	m_tail = NULL;
+	m_tailFree = 0;
+	m_detachedFree = 0;
+
+	if (!m_segments.empty() && !m_segments.back().isExternal())
+	{
+		Segment& last = m_segments.back();
+		m_tail = const_cast<unsigned char*>(last.data) + last.size;
+		m_tailFree = last.capacity - last.size;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::appendSpill(const unsigned char* data, unsigned long size)
+{
+	// Slow path of append, the data does not fit in the current chunk
+	while (size > 0)
+	{
+		if (m_tailFree == 0)
+		{
+			appendChunk();
+		}
+
+		unsigned long count = std::min(size, m_tailFree);
+		memcpy(m_tail, data, count);
+		m_tail += count;
+		m_tailFree -= count;
+		m_segments.back().size += count;
+		m_end += count;
+		data += count;
+		size -= count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::appendExternal(const std::shared_ptr<const void>& owner, const unsigned char* data, unsigned long size)
+{
+	if (size == 0)
+		return;
+
+	Segment segment;
+	segment.data = data;
+	segment.size = size;
+	segment.begin = m_end;
+	segment.owner = owner;
+	m_segments.push_back(segment);
+	m_end += size;
+
+	// Whatever is left of the current chunk is picked up by the next append
+	m_detachedFree += m_tailFree;
+	m_tailFree = 0;
+}
+
+// ----------------------------------------------------------------------------
+SegmentedBuffer::SegmentList::iterator SegmentedBuffer::findSegment(unsigned long pos)
+{
+	SegmentList::const_iterator i = static_cast<const SegmentedBuffer*>(this)->findSegment(pos);
+	return m_segments.begin() + (i - m_segments.begin());
+}
+
+// ----------------------------------------------------------------------------
+SegmentedBuffer::SegmentList::const_iterator SegmentedBuffer::findSegment(unsigned long pos) const
+{
+	// Last segment starting at or before pos
+	SegmentList::const_iterator low = m_segments.begin();
+	SegmentList::const_iterator high = m_segments.end();
+	while (high - low > 1)
+	{
+		SegmentList::const_iterator middle = low + (high - low) / 2;
+		if (middle->begin <= pos)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::write(unsigned long pos, const unsigned char* data, unsigned long size)
+{
+	assert(pos >= m_begin && pos <= m_end);
+
+	SegmentList::iterator segment = findSegment(pos);
+	while (size > 0 && pos < m_end)
+	{
+		while (pos >= segment->begin + segment->size)
+		{
+			++segment;
+		}
+
+		// External data is read-only
+		assert(!segment->isExternal());
+		unsigned long offset = pos - segment->begin;
+		unsigned long count = std::min(size, segment->size - offset);
+		memcpy(const_cast<unsigned char*>(segment->data) + offset, data, count);
+		pos += count;
+		data += count;
+		size -= count;
+	}
+
+	append(data, size);
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::read(unsigned long pos, unsigned char* data, unsigned long size) const
+{
+	assert(pos >= m_begin && pos + size <= m_end);
+
+	SegmentList::const_iterator segment = findSegment(pos);
+	while (size > 0)
+	{
+		while (pos >= segment->begin + segment->size)
+		{
+			++segment;
+		}
+
+		unsigned long offset = pos - segment->begin;
+		unsigned long count = std::min(size, segment->size - offset);
+		memcpy(data, segment->data + offset, count);
+		pos += count;
+		data += count;
+		size -= count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::truncate(unsigned long end)
+{
+	assert(end >= m_begin && end <= m_end);
+	if (end == m_end)
+		return;
+
+	SegmentList::iterator segment = findSegment(end);
+	if (segment != m_segments.end() && segment->begin < end)
+	{
+		segment->size = end - segment->begin;
+		++segment;
+	}
+	releaseSegments(segment, m_segments.end());
+	m_segments.erase(segment, m_segments.end());
+	m_end = end;
+
+	updateTail();
+}
+
+// ----------------------------------------------------------------------------
+unsigned long SegmentedBuffer::splice(SegmentedBuffer& other)
+{
+	// Appends the content of other and leaves it empty. Large chunks change
+	// hands instead of being copied, small ones are copied so that a short
+	// splice does not cost a whole chunk. Returns the number of bytes copied.
+	assert(m_pool == other.m_pool && &other != this);
+
+	unsigned long copied = 0;
+	for (SegmentList::iterator i = other.m_segments.begin(); i != other.m_segments.end(); ++i)
+	{
+		if (i->isExternal())
+		{
+			appendExternal(i->owner, i->data, i->size);
+		}
+		else if (i->chunk && i->size >= m_pool->getChunkSize() / 4)
+		{
+			Segment segment = *i;
+			segment.begin = m_end;
+			m_segments.push_back(segment);
+			m_end += segment.size;
+			i->chunk = NULL;
+
+			// Whatever room is left in our current chunk is given up. The moved
+			// chunk can only be appended to if nothing else of other lives in it.
+			m_tail = NULL;
+			m_tailFree = 0;
+			m_detachedFree = 0;
+			if (i + 1 == other.m_segments.end())
+			{
+				m_tail = const_cast<unsigned char*>(segment.data) + segment.size;
+				m_tailFree = segment.capacity - segment.size;
+			}
+		}
+		else
+		{
+			append(i->data, i->size);
+			copied += i->size;
+		}
+	}
+
+	other.clear();
+	return copied;
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::swap(SegmentedBuffer& other)
+{
+	std::swap(m_pool, other.m_pool);
+	m_segments.swap(other.m_segments);
+	std::swap(m_begin, other.m_begin);
+	std::swap(m_end, other.m_end);
+	std::swap(m_tail, other.m_tail);
+	std::swap(m_tailFree, other.m_tailFree);
+	std::swap(m_detachedFree, other.m_detachedFree);
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::releaseSegments(SegmentList::iterator first, SegmentList::iterator last)
+{
+	for (SegmentList::iterator i = first; i != last; ++i)
+	{
+		if (i->chunk == NULL)
+			continue;
+
+		// A chunk interrupted by external data continues in a later segment,
+		// which takes over the chunk if it is not released as well.
+		unsigned char* chunkEnd = i->chunk + m_pool->getChunkSize();
+		SegmentList::iterator next = last;
+		while (next != m_segments.end() && (next->isExternal() || (next->data > i->chunk && next->data < chunkEnd)))
+		{
+			if (!next->isExternal())
+			{
+				next->chunk = i->chunk;
+				i->chunk = NULL;
+				break;
+			}
+			++next;
+		}
+
+		if (i->chunk)
+		{
+			if (m_tail >= i->chunk && m_tail <= chunkEnd)
+			{
+				m_tail = NULL;
+				m_tailFree = 0;
+				m_detachedFree = 0;
+			}
+			m_pool->release(i->chunk);
+			i->chunk = NULL;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::getSpans(unsigned long begin, unsigned long end, DataSpanList& spans) const
+{
+	assert(begin >= m_begin && end <= m_end);
+	if (begin >= end)
+		return;
+
+	for (SegmentList::const_iterator i = findSegment(begin); i != m_segments.end() && i->begin < end; ++i)
+	{
+		unsigned long first = std::max(begin, i->begin);
+		unsigned long last = std::min(end, i->begin + i->size);
+		if (first < last)
+		{
+			spans.push_back(DataSpan(i->data + (first - i->begin), last - first, i->isExternal()));
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::discardFront(unsigned long end)
+{
+	assert(end >= m_begin && end <= m_end);
+
+	SegmentList::iterator segment = m_segments.begin();
+	while (segment != m_segments.end() && segment->begin + segment->size <= end)
+	{
+		++segment;
+	}
+
+	// Keep appending to the tail chunk even when all of its bytes are gone
+	if (segment == m_segments.end() && !m_segments.empty() && !m_segments.back().isExternal() && m_tailFree > 0)
+	{
+		--segment;
+	}
+
+	releaseSegments(m_segments.begin(), segment);
+	m_segments.erase(m_segments.begin(), segment);
+
+	if (!m_segments.empty() && m_segments.front().begin < end)
+	{
+		Segment& first = m_segments.front();
+		unsigned long count = std::min(end - first.begin, first.size);
+		first.data += count;
+		first.size -= count;
+		first.begin += count;
+		if (!first.isExternal())
+		{
+			first.capacity -= count;
+		}
+	}
+	m_begin = end;
+}
+
+// ----------------------------------------------------------------------------
+void SegmentedBuffer::clear(unsigned long begin)
+{
+	releaseSegments(m_segments.begin(), m_segments.end());
+	m_segments.clear();
+	m_begin = begin;
+	m_end = begin;
+	updateTail();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "DataSpan.h"
+
+// ----------------------------------------------------------------------------
+// Recycles the fixed-size chunks SegmentedBuffers are built from. Shared
+// between buffers (and threads), so a process writing many files stops
+// allocating once it has reached its working set.
+class ChunkPool
+{
+public:
+	enum { DEFAULT_CHUNK_SIZE = 64 * 1024 };
+
+private:
+	unsigned int m_chunkSize;
+	std::vector<unsigned char*> m_freeChunks;
+	std::mutex m_mutex;
+	std::atomic<unsigned long> m_allocationCount;
+
+private:
+	ChunkPool(const ChunkPool&);
+	ChunkPool& operator=(const ChunkPool&);
+
+public:
+	explicit ChunkPool(unsigned int chunkSize = DEFAULT_CHUNK_SIZE);
+	~ChunkPool();
+
+	static ChunkPool& getDefault();
+
+	inline unsigned int getChunkSize() const { return m_chunkSize; }
+
+	unsigned char* allocate();
+	void release(unsigned char* chunk);
+	void trim();
+
+	// Chunks allocated from the heap, as opposed to recycled
+	inline unsigned long getAllocationCount() const { return m_allocationCount; }
+};
+
+// ----------------------------------------------------------------------------
+// Byte buffer made of a chain of pool chunks and referenced external data.
+// Appending never moves existing bytes, positions can be patched in place and
+// the content is read back as a list of spans without being flattened.
+// Positions are absolute: discarding data from the front does not renumber
+// what is left.
+class SegmentedBuffer
+{
+private:
+	struct Segment
+	{
+		const unsigned char* data;
+		unsigned long size;
+		unsigned long begin;				// Absolute position of data[0]
+		unsigned long capacity;				// Room from data to the end of its chunk, 0 for external data
+		unsigned char* chunk;				// Pool chunk released with this segment, if any
+		std::shared_ptr<const void> owner;	// Keeps external data alive
+
+		Segment() : data(0), size(0), begin(0), capacity(0), chunk(0) {}
+		inline bool isExternal() const { return capacity == 0; }
+	};
+	typedef std::vector<Segment> SegmentList;
+
+private:
+	ChunkPool* m_pool;
+	SegmentList m_segments;
+	unsigned long m_begin;
+	unsigned long m_end;
+
+	unsigned char* m_tail;		// Free space at the end of the last chunk
+	unsigned long m_tailFree;
+	unsigned long m_detachedFree;	// Tail space left behind by external data
+
+private:
+	SegmentedBuffer(const SegmentedBuffer&);
+	SegmentedBuffer& operator=(const SegmentedBuffer&);
+
+	void appendChunk();
+	void appendSpill(const unsigned char* data, unsigned long size);
+	void updateTail();
+	void releaseSegments(SegmentList::iterator first, SegmentList::iterator last);
+	SegmentList::iterator findSegment(unsigned long pos);
+	SegmentList::const_iterator findSegment(unsigned long pos) const;
+
+public:
+	explicit SegmentedBuffer(ChunkPool* pool = &ChunkPool::getDefault());
+	~SegmentedBuffer();
+
+	inline unsigned long getBegin() const { return m_begin; }
+	inline unsigned long getEnd() const { return m_end; }
+	inline unsigned long getSize() const { return m_end - m_begin; }
+	inline bool isEmpty() const { return m_end == m_begin; }
+
+	inline void append(unsigned char value)
+	{
+		if (m_tailFree == 0)
+		{
+			appendChunk();
+		}
+		*m_tail++ = value;
+		--m_tailFree;
+		++m_segments.back().size;
+		++m_end;
+	}
+	inline void append(const unsigned char* data, unsigned long size)
+	{
+		if (size <= m_tailFree)
+		{
+			memcpy(m_tail, data, size);
+			m_tail += size;
+			m_tailFree -= size;
+			m_segments.back().size += size;
+			m_end += size;
+		}
+		else
+		{
+			appendSpill(data, size);
+		}
+	}
+	void appendExternal(const std::shared_ptr<const void>& owner, const unsigned char* data, unsigned long size);
+
+	void write(unsigned long pos, const unsigned char* data, unsigned long size);
+	void read(unsigned long pos, unsigned char* data, unsigned long size) const;
+	void truncate(unsigned long end);
+
+	unsigned long splice(SegmentedBuffer& other);
+	void swap(SegmentedBuffer& other);
+
+	void getSpans(unsigned long begin, unsigned long end, DataSpanList& spans) const;
+	void discardFront(unsigned long end);
+	void clear(unsigned long begin = 0);
+};
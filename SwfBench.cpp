@@ -0,0 +1,948 @@
+// ----------------------------------------------------------------------------
+// Benchmarks of the writer hot paths on synthetic workloads. This is the main
+// of a separate executable, not part of the library sources. The CMake build
+// has it as the swfbench target, in a Release build by default:
+//
+//   cmake -S . -B build -DSWF_USE_LZMA=ON
+//   cmake --build build --target swfbench
+//
+// Turn on SWF_USE_AVX2 to measure the AVX2 pixel conversion.
+//
+// usage: swfbench [--json] [--filter <text>] [--min-time <seconds>] [--dir <path>]
+//
+// Every benchmark grows its operation count until a run takes at least the
+// minimum time and reports that last run. Output files go to the null device,
+// the synthetic JPEG input is written to --dir, so are the large SWF files
+// the reader benchmarks index (about 270 MB each, made on first use). The JSON layout (format 1)
+// only ever gains fields, so results can be compared between releases.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "SwfWriter.h"
+#include "Compress.h"
+#include "ScreenVideo.h"
+#include "ADPCMStream.h"
+#include "SwfReader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+// ----------------------------------------------------------------------------
+// Exposes the protected record and bit field writers
+class BenchWriter : public SwfWriter
+{
+public:
+	using SwfWriter::writeRect;
+	using SwfWriter::writeRecordHeaderStart;
+	using SwfWriter::writeRecordHeaderEnd;
+	using FileWriter::getFileSize;
+};
+
+// ----------------------------------------------------------------------------
+// An edge of the synthetic shape, control deltas only used by curves
+struct ShapeEdge
+{
+	int controlX;
+	int controlY;
+	int anchorX;
+	int anchorY;
+	bool curved;
+};
+
+// ----------------------------------------------------------------------------
+struct Context
+{
+	std::wstring nullFile;
+	std::wstring jpegFile;
+	FileWriter::Buffer mp3Block;
+	FileWriter::Buffer compressInput;
+	FileWriter::Buffer pixels;			// RGBA frame with padded rows
+	unsigned int pixelWidth;
+	unsigned int pixelHeight;
+	long pixelStride;
+	std::vector<short> pcm;				// A second of 44.1 kHz stereo
+	std::wstring readerFile[2];			// FWS and CWS, written by the first reader benchmark
+	std::vector<ShapeEdge> shapeEdges;	// One large outline
+};
+
+// ----------------------------------------------------------------------------
+struct Bench
+{
+	unsigned long long ops;		// Requested by the harness
+	unsigned long long bytes;	// Produced or consumed by the run, 0 when meaningless
+};
+
+typedef void (*BenchFunction)(Bench& bench, const Context& context);
+
+// ----------------------------------------------------------------------------
+struct Result
+{
+	const char* name;
+	unsigned long long ops;
+	double nsPerOp;
+	double mbPerSecond;
+	unsigned long long peakRSS;	// Bytes, for the whole process so far
+};
+
+// ----------------------------------------------------------------------------
+unsigned long long getPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024ull;
+#endif
+#endif
+}
+
+// ----------------------------------------------------------------------------
+std::wstring widen(const std::string& text)
+{
+	return std::wstring(text.begin(), text.end());
+}
+
+// ----------------------------------------------------------------------------
+// Deterministic filler, the results must not depend on the C library rand()
+unsigned long nextRandom(unsigned long& state)
+{
+	state = state * 1103515245 + 12345;
+	return (state >> 16) & 0x7fff;
+}
+
+// ----------------------------------------------------------------------------
+// Runs body over bench.ops operations, split into documents of at most
+// opsPerDocument so the buffered content stays bounded
+template <class Body>
+void runDocuments(Bench& bench, const Context& context, unsigned long opsPerDocument, bool compress, Body body)
+{
+	BenchWriter writer;
+	writer.setCompression(compress);
+	writer.setDeduplicateAssets(false);
+	writer.setReuse(true);
+	writer.setFrameRect(0, 11000, 0, 8000);
+
+	unsigned long long done = 0;
+	bench.bytes = 0;
+	while (done < bench.ops)
+	{
+		unsigned long count = static_cast<unsigned long>(std::min<unsigned long long>(bench.ops - done, opsPerDocument));
+		writer.open(context.nullFile);
+		writer.outputHeader();
+		unsigned long start = writer.getFileSize();
+		body(writer, done, count);
+		bench.bytes += writer.getFileSize() - start;
+		writer.outputEnd();
+		writer.close();
+		done += count;
+	}
+}
+
+// ----------------------------------------------------------------------------
+void benchWriteBits(Bench& bench, const Context& context)
+{
+	runDocuments(bench, context, 1 << 20, false, [](BenchWriter& writer, unsigned long long first, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.writeBits(static_cast<int>((first + i) & 0x1fff), 13);
+			if ((i & 63) == 63)
+			{
+				writer.flushWriteBits();
+			}
+		}
+		writer.flushWriteBits();
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchWriteRect(Bench& bench, const Context& context)
+{
+	runDocuments(bench, context, 1 << 18, false, [](BenchWriter& writer, unsigned long long first, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			int value = static_cast<int>((first + i) % 20000);
+			writer.writeRect(SwfWriter::Rect(-value, value, value / 2, value * 3));
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+// The packer the writer had before BitWriter, kept to measure against: bits
+// collect in one byte, every full byte goes through writeByte, and the field
+// widths come from shift loops
+class LegacyBitPacker
+{
+private:
+	FileWriter& m_writer;
+	unsigned int m_bitPos;
+	unsigned int m_bitBuf;
+
+public:
+	explicit LegacyBitPacker(FileWriter& writer) : m_writer(writer), m_bitPos(8), m_bitBuf(0) {}
+
+	static unsigned int countRequiredBits(unsigned int value)
+	{
+		unsigned int numBits = 0;
+		while (value & ~0xF)
+		{
+			value >>= 4;
+			numBits += 4;
+		}
+		while (value)
+		{
+			value >>= 1;
+			++numBits;
+		}
+		return numBits;
+	}
+
+	void writeBits(int value, unsigned int numBits)
+	{
+		for (;;)
+		{
+			value &= (unsigned int) 0xffffffff >> (32 - numBits);
+			int s = numBits - m_bitPos;
+			if (s <= 0)
+			{
+				m_bitBuf |= value << -s;
+				m_bitPos -= numBits;
+				return;
+			}
+
+			m_bitBuf |= value >> s;
+			numBits -= m_bitPos;
+			m_writer.writeByte(static_cast<unsigned char>(m_bitBuf));
+			m_bitBuf = 0;
+			m_bitPos = 8;
+		}
+	}
+
+	void flushWriteBits()
+	{
+		if (m_bitPos < 8)
+		{
+			m_writer.writeByte(static_cast<unsigned char>(m_bitBuf));
+			m_bitBuf = 0;
+			m_bitPos = 8;
+		}
+	}
+};
+
+// ----------------------------------------------------------------------------
+// The writer's own BitWriter behind the same interface
+class CurrentBitPacker
+{
+private:
+	FileWriter& m_writer;
+
+public:
+	explicit CurrentBitPacker(FileWriter& writer) : m_writer(writer) {}
+
+	static unsigned int countRequiredBits(unsigned int value) { return BitWriter::countRequiredBits(value); }
+	void writeBits(int value, unsigned int numBits) { m_writer.writeBits(value, numBits); }
+	void flushWriteBits() { m_writer.flushWriteBits(); }
+};
+
+// ----------------------------------------------------------------------------
+// A DefineShape without styles holding one outline of edge records. Both
+// packers produce the same bytes.
+template <class Packer>
+void writeShape(BenchWriter& writer, const std::vector<ShapeEdge>& edges)
+{
+	writer.writeRecordHeaderStart(SwfWriter::SwfTag_DefineShape);
+	writer.writeWord(1);
+	writer.writeRect(SwfWriter::Rect(-20000, 20000, -20000, 20000));
+	writer.writeByte(0);	// No fill styles
+	writer.writeByte(0);	// No line styles
+
+	Packer packer(writer);
+	packer.writeBits(0, 4);		// Fill and line style index bits
+	packer.writeBits(0, 4);
+
+	// Style change record moving to the origin
+	packer.writeBits(0, 1);
+	packer.writeBits(1, 5);
+	packer.writeBits(1, 5);
+	packer.writeBits(0, 1);
+	packer.writeBits(0, 1);
+
+	for (std::vector<ShapeEdge>::const_iterator i = edges.begin(); i != edges.end(); ++i)
+	{
+		unsigned int greatest = static_cast<unsigned int>(std::max(std::abs(i->anchorX), std::abs(i->anchorY)));
+		if (i->curved)
+		{
+			greatest = std::max(greatest, static_cast<unsigned int>(std::max(std::abs(i->controlX), std::abs(i->controlY))));
+		}
+		unsigned int numBits = Packer::countRequiredBits(greatest) + 1;
+
+		packer.writeBits(1, 1);		// Edge record
+		packer.writeBits(i->curved ? 0 : 1, 1);
+		packer.writeBits(numBits - 2, 4);
+		if (i->curved)
+		{
+			packer.writeBits(i->controlX, numBits);
+			packer.writeBits(i->controlY, numBits);
+			packer.writeBits(i->anchorX, numBits);
+			packer.writeBits(i->anchorY, numBits);
+		}
+		else if (i->anchorX != 0 && i->anchorY != 0)
+		{
+			packer.writeBits(1, 1);	// General line
+			packer.writeBits(i->anchorX, numBits);
+			packer.writeBits(i->anchorY, numBits);
+		}
+		else
+		{
+			packer.writeBits(0, 1);
+			packer.writeBits(i->anchorX == 0 ? 1 : 0, 1);
+			packer.writeBits(i->anchorX == 0 ? i->anchorY : i->anchorX, numBits);
+		}
+	}
+
+	packer.writeBits(0, 6);		// End shape record
+	packer.flushWriteBits();
+	writer.writeRecordHeaderEnd();
+}
+
+// ----------------------------------------------------------------------------
+template <class Packer>
+void benchShape(Bench& bench, const Context& context)
+{
+	// One operation is one shape with all the edges of the context
+	runDocuments(bench, context, 64, false, [&context](BenchWriter& writer, unsigned long long /*first*/, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writeShape<Packer>(writer, context.shapeEdges);
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchShapeEdges(Bench& bench, const Context& context)
+{
+	benchShape<CurrentBitPacker>(bench, context);
+}
+
+// ----------------------------------------------------------------------------
+void benchShapeEdgesLegacy(Bench& bench, const Context& context)
+{
+	benchShape<LegacyBitPacker>(bench, context);
+}
+
+// ----------------------------------------------------------------------------
+void benchSizedRecord(Bench& bench, const Context& context)
+{
+	runDocuments(bench, context, 1 << 18, false, [](BenchWriter& writer, unsigned long long first, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.writeRecordHeaderStart(SwfWriter::SwfTag_DoAction, 4);
+			writer.writeLong(static_cast<unsigned long>(first + i));
+			writer.writeRecordHeaderEnd();
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchUnsizedRecord(Bench& bench, const Context& context)
+{
+	// The size is fixed up once the body is complete
+	runDocuments(bench, context, 1 << 18, false, [](BenchWriter& writer, unsigned long long first, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.writeRecordHeaderStart(SwfWriter::SwfTag_DoAction);
+			writer.writeLong(static_cast<unsigned long>(first + i));
+			writer.writeRecordHeaderEnd();
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchPlaceObjectTimeline(Bench& bench, const Context& context)
+{
+	// One operation places an object, every 16th one also ends the frame
+	runDocuments(bench, context, 1 << 18, false, [](BenchWriter& writer, unsigned long long first, unsigned long count)
+	{
+		static const std::wstring name(L"instance");
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			unsigned int depth = static_cast<unsigned int>((first + i) & 0xff) + 1;
+			if (i & 1)
+			{
+				writer.outputPlaceObject2(1, depth, name);
+			}
+			else
+			{
+				writer.outputPlaceObject2(1, depth);
+			}
+			if ((i & 15) == 15)
+			{
+				writer.outputShowFrame(true);
+			}
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchNestedSprites(Bench& bench, const Context& context)
+{
+	// One operation defines a sprite holding another sprite
+	runDocuments(bench, context, 1 << 15, false, [](BenchWriter& writer, unsigned long long /*first*/, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.outputDefineSpriteBegin(1);
+			SwfWriter::CharacterID inner = writer.outputDefineSpriteBegin(2);
+			writer.outputPlaceObject2(1, 1);
+			writer.outputShowFrame(false);
+			writer.outputRemoveObject2(1);
+			writer.outputShowFrame(false);
+			writer.outputDefineSpriteEnd();
+			writer.outputPlaceObject2(inner, 1);
+			writer.outputShowFrame(false);
+			writer.outputDefineSpriteEnd();
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchJPEGPayload(Bench& bench, const Context& context)
+{
+	const std::wstring& jpegFile = context.jpegFile;
+	runDocuments(bench, context, 64, false, [&jpegFile](BenchWriter& writer, unsigned long long, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.outputDefineBitsJPEG2(jpegFile);
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchMP3Payload(Bench& bench, const Context& context)
+{
+	const FileWriter::Buffer& block = context.mp3Block;
+	runDocuments(bench, context, 256, false, [&block](BenchWriter& writer, unsigned long long, unsigned long count)
+	{
+		writer.outputSoundStreamBegin(SwfWriter::SwfSampleRate_44KHz, SwfWriter::SwfSndStereo, SwfWriter::SwfMP3,
+									  SwfWriter::SwfSampleRate_44KHz, SwfWriter::SwfSndStereo);
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.outputMP3StreamBlock(1152, 0, block);
+			writer.outputShowFrame(true);
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchLosslessPayload(Bench& bench, const Context& context)
+{
+	runDocuments(bench, context, 16, false, [&context](BenchWriter& writer, unsigned long long, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			writer.outputDefineBitsLossless2(&context.pixels[0], context.pixelWidth, context.pixelHeight,
+											 context.pixelStride, PixelFormat_RGBA);
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+void benchPremultiply(Bench& bench, const Context& context)
+{
+	FileWriter::Buffer argb(context.pixelWidth * context.pixelHeight * 4);
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		convertToARGB(&context.pixels[0], context.pixelWidth, context.pixelHeight, context.pixelStride,
+					  PixelFormat_RGBA, Alpha_Premultiply, &argb[0]);
+	}
+	bench.bytes = bench.ops * argb.size();
+}
+
+// ----------------------------------------------------------------------------
+void benchADPCMEncode(Bench& bench, const Context& context)
+{
+	// One operation encodes a second of stereo sound into 30 blocks
+	ADPCMStream stream;
+	stream.setSamples(&context.pcm[0], context.pcm.size() / 2, 44100, 2);
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		stream.encode(30 << 8, NULL);
+	}
+	bench.bytes = bench.ops * context.pcm.size() * sizeof(short);
+}
+
+// ----------------------------------------------------------------------------
+void benchScreenVideo(Bench& bench, const Context& context)
+{
+	// A mostly static screen, one operation is a frame with a small part changed
+	FileWriter::Buffer frame(context.pixels);
+	ScreenVideoEncoder encoder;
+	encoder.begin(context.pixelWidth, context.pixelHeight);
+	FileWriter::Buffer packet;
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		unsigned long pos = static_cast<unsigned long>((i * 4099) % frame.size());
+		frame[pos] = static_cast<unsigned char>(frame[pos] + 1);
+		encoder.encodeFrame(&frame[0], context.pixelStride, PixelFormat_RGBA, packet);
+	}
+	bench.bytes = bench.ops * context.pixelWidth * context.pixelHeight * 4;
+}
+
+// ----------------------------------------------------------------------------
+// 256 one megabyte JPEGs and 32768 frames of 64 placements, written once.
+// Streamed, so the append benchmarks continue the CWS file in place.
+const std::wstring& makeReaderInput(const Context& context, bool compress)
+{
+	static bool written[2] = { false, false };
+	const std::wstring& filename = context.readerFile[compress ? 1 : 0];
+	if (!written[compress ? 1 : 0])
+	{
+		SwfWriter writer;
+		writer.setCompression(compress);
+		writer.setCompressionTier(Compressor::TIER_FAST);
+		writer.setDeduplicateAssets(false);
+		writer.setStreaming(true);
+		writer.setFrameRect(0, 11000, 0, 8000);
+		writer.open(filename);
+		writer.outputHeader();
+		for (unsigned int frame = 0; frame < 32768; ++frame)
+		{
+			if ((frame & 127) == 0)
+			{
+				writer.outputDefineBitsJPEG2(context.jpegFile);
+			}
+			for (unsigned int depth = 1; depth <= 64; ++depth)
+			{
+				writer.outputPlaceObject2(1, depth);
+			}
+			writer.outputShowFrame(true);
+		}
+		writer.outputEnd();
+		writer.close();
+		written[compress ? 1 : 0] = true;
+	}
+	return filename;
+}
+
+// ----------------------------------------------------------------------------
+void benchReader(Bench& bench, const Context& context, bool compress)
+{
+	// One operation opens and indexes the whole file, then looks up a
+	// character and a frame
+	const std::wstring& filename = makeReaderInput(context, compress);
+	bench.bytes = 0;
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		SwfReader reader;
+		reader.open(filename);
+		unsigned long first = 0;
+		unsigned long last = 0;
+		reader.getFrameTags(reader.getFrameCount() / 2, first, last);
+		reader.findCharacter(static_cast<SwfWriter::CharacterID>(i % 256 + 1));
+		bench.bytes += reader.getSize();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void benchReaderFWS(Bench& bench, const Context& context)
+{
+	benchReader(bench, context, false);
+}
+
+// ----------------------------------------------------------------------------
+void benchReaderCWS(Bench& bench, const Context& context)
+{
+	benchReader(bench, context, true);
+}
+
+// ----------------------------------------------------------------------------
+void benchAppend(Bench& bench, const Context& context, bool compress)
+{
+	// One operation adds a frame of 64 placements to the reader input, the
+	// alternative being to write the whole file again
+	const std::wstring& filename = makeReaderInput(context, compress);
+	bench.bytes = 0;
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		SwfWriter writer;
+		writer.openAppend(filename);
+		for (unsigned int depth = 1; depth <= 64; ++depth)
+		{
+			writer.outputPlaceObject2(1, depth);
+		}
+		writer.outputShowFrame(true);
+		writer.outputEnd();
+		writer.close();
+		bench.bytes += 64 * 7 + 2;			// Tags added
+	}
+}
+
+// ----------------------------------------------------------------------------
+void benchAppendFWS(Bench& bench, const Context& context)
+{
+	benchAppend(bench, context, false);
+}
+
+// ----------------------------------------------------------------------------
+void benchAppendCWS(Bench& bench, const Context& context)
+{
+	benchAppend(bench, context, true);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompress(Bench& bench, const Context& context, ZLIBCompressor::CompressionLevel level)
+{
+	ZLIBCompressor compressor;
+	compressor.setLevel(level);
+
+	DataSpanList spans;
+	spans.push_back(DataSpan(&context.compressInput[0], context.compressInput.size()));
+
+	std::vector<unsigned char> output;
+	for (unsigned long long i = 0; i < bench.ops; ++i)
+	{
+		compressor.compress(spans, output);
+	}
+	bench.bytes = bench.ops * context.compressInput.size();
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressStore(Bench& bench, const Context& context)
+{
+	benchCompress(bench, context, ZLIBCompressor::ZLIB_NO_COMPRESSION);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressBestSpeed(Bench& bench, const Context& context)
+{
+	benchCompress(bench, context, ZLIBCompressor::ZLIB_BEST_SPEED);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressFast(Bench& bench, const Context& context)
+{
+	benchCompress(bench, context, ZLIBCompressor::ZLIB_FAST_COMPRESSION);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressMedium(Bench& bench, const Context& context)
+{
+	benchCompress(bench, context, ZLIBCompressor::ZLIB_MEDIUM_COMPRESSION);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressBest(Bench& bench, const Context& context)
+{
+	benchCompress(bench, context, ZLIBCompressor::ZLIB_BEST_COMPRESSION);
+}
+
+// ----------------------------------------------------------------------------
+void benchCompressedDocument(Bench& bench, const Context& context)
+{
+	// Whole CWS documents, one operation is one frame of 64 placements
+	runDocuments(bench, context, 1024, true, [](BenchWriter& writer, unsigned long long, unsigned long count)
+	{
+		for (unsigned long i = 0; i < count; ++i)
+		{
+			for (unsigned int depth = 1; depth <= 64; ++depth)
+			{
+				writer.outputPlaceObject2(1, depth);
+			}
+			writer.outputShowFrame(true);
+		}
+	});
+}
+
+// ----------------------------------------------------------------------------
+struct BenchEntry
+{
+	const char* name;
+	BenchFunction function;
+};
+
+const BenchEntry s_benchmarks[] =
+{
+	{ "bits/writeBits",				benchWriteBits },
+	{ "bits/writeRect",				benchWriteRect },
+	{ "bits/shapeEdges",			benchShapeEdges },
+	{ "bits/shapeEdgesLegacy",		benchShapeEdgesLegacy },
+	{ "record/sized",				benchSizedRecord },
+	{ "record/fixup",				benchUnsizedRecord },
+	{ "timeline/placeObject2",		benchPlaceObjectTimeline },
+	{ "timeline/nestedSprites",		benchNestedSprites },
+	{ "payload/jpeg",				benchJPEGPayload },
+	{ "payload/mp3",				benchMP3Payload },
+	{ "payload/lossless2",			benchLosslessPayload },
+	{ "pixels/premultiply",			benchPremultiply },
+	{ "video/screen",				benchScreenVideo },
+	{ "sound/adpcm",				benchADPCMEncode },
+	{ "reader/fws",					benchReaderFWS },
+	{ "reader/cws",					benchReaderCWS },
+	{ "append/fws",					benchAppendFWS },
+	{ "append/cws",					benchAppendCWS },
+	{ "compress/zlib0",				benchCompressStore },
+	{ "compress/zlib1",				benchCompressBestSpeed },
+	{ "compress/zlib3",				benchCompressFast },
+	{ "compress/zlib6",				benchCompressMedium },
+	{ "compress/zlib9",				benchCompressBest },
+	{ "document/cws",				benchCompressedDocument }
+};
+
+// ----------------------------------------------------------------------------
+Result runBenchmark(const BenchEntry& entry, const Context& context, double minTime)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Bench bench;
+	bench.ops = 1;
+	double seconds = 0;
+	for (;;)
+	{
+		bench.bytes = 0;
+		Clock::time_point start = Clock::now();
+		entry.function(bench, context);
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds >= minTime || bench.ops >= (1ull << 40))
+			break;
+
+		// Aim a little past the minimum, but never grow by more than 100x
+		double scale = seconds > 0 ? minTime * 1.2 / seconds : 100;
+		bench.ops = static_cast<unsigned long long>(bench.ops * std::max(2.0, std::min(100.0, scale)));
+	}
+
+	Result result;
+	result.name = entry.name;
+	result.ops = bench.ops;
+	result.nsPerOp = seconds * 1e9 / bench.ops;
+	result.mbPerSecond = seconds > 0 ? bench.bytes / seconds / (1024.0 * 1024.0) : 0;
+	result.peakRSS = getPeakRSS();
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+bool prepareContext(const std::string& directory, Context& context)
+{
+#ifdef _WIN32
+	context.nullFile = L"NUL";
+#else
+	context.nullFile = L"/dev/null";
+#endif
+
+	unsigned long state = 1;
+
+	// 1 MB of noise between SOI and EOI markers passes for a JPEG
+	std::string jpegFile = directory + "/swfbench.jpg";
+	FILE* file = fopen(jpegFile.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	std::vector<unsigned char> jpeg(1024 * 1024);
+	for (size_t i = 0; i < jpeg.size(); ++i)
+	{
+		jpeg[i] = static_cast<unsigned char>(nextRandom(state));
+	}
+	jpeg[0] = 0xff;
+	jpeg[1] = 0xd8;
+	jpeg[jpeg.size() - 2] = 0xff;
+	jpeg[jpeg.size() - 1] = 0xd9;
+	bool written = fwrite(&jpeg[0], 1, jpeg.size(), file) == jpeg.size();
+	fclose(file);
+	if (!written)
+		return false;
+
+	context.jpegFile = widen(jpegFile);
+	context.readerFile[0] = widen(directory + "/swfbench_reader_fws.swf");
+	context.readerFile[1] = widen(directory + "/swfbench_reader_cws.swf");
+
+	// A 320 kbit/s frame worth of noise, MP3 data does not compress either
+	context.mp3Block.resize(1044);
+	for (size_t i = 0; i < context.mp3Block.size(); ++i)
+	{
+		context.mp3Block[i] = static_cast<unsigned char>(nextRandom(state));
+	}
+
+	// 4 MB resembling a SWF body: records picked from a few dozen shapes, each
+	// followed by a couple of varying bytes such as ids and depths
+	std::vector<std::vector<unsigned char> > records(48);
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		records[i].resize(4 + nextRandom(state) % 28);
+		for (size_t j = 0; j < records[i].size(); ++j)
+		{
+			records[i][j] = static_cast<unsigned char>(nextRandom(state));
+		}
+	}
+
+	context.compressInput.clear();
+	context.compressInput.reserve(4 * 1024 * 1024 + 64);
+	while (context.compressInput.size() < 4 * 1024 * 1024)
+	{
+		const std::vector<unsigned char>& record = records[nextRandom(state) % records.size()];
+		context.compressInput.insert(context.compressInput.end(), record.begin(), record.end());
+		context.compressInput.push_back(static_cast<unsigned char>(nextRandom(state)));
+		context.compressInput.push_back(static_cast<unsigned char>(context.compressInput.size() >> 8));
+	}
+
+	// A rendered looking frame: gradients, a noisy alpha edge and row padding
+	context.pixelWidth = 512;
+	context.pixelHeight = 512;
+	context.pixelStride = context.pixelWidth * 4 + 64;
+	context.pixels.assign(context.pixelStride * context.pixelHeight, 0);
+	for (unsigned int y = 0; y < context.pixelHeight; ++y)
+	{
+		unsigned char* row = &context.pixels[y * context.pixelStride];
+		for (unsigned int x = 0; x < context.pixelWidth; ++x)
+		{
+			row[x * 4] = static_cast<unsigned char>(x);
+			row[x * 4 + 1] = static_cast<unsigned char>(y);
+			row[x * 4 + 2] = static_cast<unsigned char>(x + y);
+			row[x * 4 + 3] = (x < 256) ? 255 : static_cast<unsigned char>(nextRandom(state));
+		}
+	}
+
+	// Two tones and a little noise
+	context.pcm.resize(44100 * 2);
+	for (size_t i = 0; i < context.pcm.size(); i += 2)
+	{
+		int noise = static_cast<int>(nextRandom(state) % 512) - 256;
+		context.pcm[i] = static_cast<short>(12000 * sin(i * 0.02) + noise);
+		context.pcm[i + 1] = static_cast<short>(9000 * sin(i * 0.007) + noise);
+	}
+
+	// 8192 edges, a mix of curves, general lines and vertical or horizontal
+	// lines with field widths from 2 to 15 bits
+	context.shapeEdges.resize(8192);
+	for (size_t i = 0; i < context.shapeEdges.size(); ++i)
+	{
+		int delta[4];
+		for (int j = 0; j < 4; ++j)
+		{
+			int magnitude = 1 << (nextRandom(state) % 14);
+			delta[j] = static_cast<int>(nextRandom(state) % magnitude) + 1;
+			delta[j] = (nextRandom(state) & 1) ? -delta[j] : delta[j];
+		}
+
+		ShapeEdge& edge = context.shapeEdges[i];
+		unsigned long kind = nextRandom(state) % 4;
+		edge.curved = kind == 0;
+		edge.controlX = delta[0];
+		edge.controlY = delta[1];
+		edge.anchorX = kind == 2 ? 0 : delta[2];
+		edge.anchorY = kind == 3 ? 0 : delta[3];
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void printText(const std::vector<Result>& results)
+{
+	printf("%-26s %14s %14s %12s %14s\n", "benchmark", "ops", "ns/op", "MB/s", "peak RSS KB");
+	for (std::vector<Result>::const_iterator i = results.begin(); i != results.end(); ++i)
+	{
+		printf("%-26s %14llu %14.2f %12.2f %14llu\n", i->name, i->ops, i->nsPerOp, i->mbPerSecond, i->peakRSS / 1024);
+	}
+}
+
+// ----------------------------------------------------------------------------
+void printJSON(const std::vector<Result>& results)
+{
+	printf("{\n\t\"format\": 1,\n\t\"benchmarks\": [");
+	for (std::vector<Result>::const_iterator i = results.begin(); i != results.end(); ++i)
+	{
+		printf("%s\n\t\t{ \"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"mb_per_s\": %.3f, \"peak_rss_kb\": %llu }",
+			   i == results.begin() ? "" : ",", i->name, i->ops, i->nsPerOp, i->mbPerSecond, i->peakRSS / 1024);
+	}
+	printf("\n\t]\n}\n");
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	bool json = false;
+	std::string filter;
+	std::string directory = ".";
+	double minTime = 0.5;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+		{
+			json = true;
+		}
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+		{
+			directory = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [--json] [--filter <text>] [--min-time <seconds>] [--dir <path>]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	Context context;
+	if (!prepareContext(directory, context))
+	{
+		fprintf(stderr, "cannot write the benchmark input to %s\n", directory.c_str());
+		return 1;
+	}
+
+	std::vector<Result> results;
+	for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); ++i)
+	{
+		if (!filter.empty() && strstr(s_benchmarks[i].name, filter.c_str()) == NULL)
+			continue;
+
+		results.push_back(runBenchmark(s_benchmarks[i], context, minTime));
+		if (!json)
+		{
+			fprintf(stderr, "%s done\n", s_benchmarks[i].name);
+		}
+	}
+
+	if (json)
+	{
+		printJSON(results);
+	}
+	else
+	{
+		printText(results);
+	}
+	return 0;
+}
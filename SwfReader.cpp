@@ -0,0 +1,373 @@
+#include <string.h>
+#include <algorithm>
+#include "zlib.h"
+#ifdef SWF_USE_LZMA
+#include "lzma.h"
+#endif
+#include "SwfReader.h"
+
+// ----------------------------------------------------------------------------
+static inline unsigned int readWord(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+// ----------------------------------------------------------------------------
+static inline unsigned long readLong(const unsigned char* p)
+{
+	return static_cast<unsigned long>(p[0]) | (static_cast<unsigned long>(p[1]) << 8) |
+		   (static_cast<unsigned long>(p[2]) << 16) | (static_cast<unsigned long>(p[3]) << 24);
+}
+
+// ----------------------------------------------------------------------------
+// Signed MSB-first bit field, the counterpart of BitWriter::writeBits()
+static int readBits(const unsigned char* data, unsigned long& bitPos, unsigned int numBits)
+{
+	unsigned int value = 0;
+	for (unsigned int i = 0; i < numBits; ++i, ++bitPos)
+	{
+		value = (value << 1) | ((data[bitPos >> 3] >> (7 - (bitPos & 7))) & 1);
+	}
+	if (numBits > 0 && numBits < 32 && (value & (1u << (numBits - 1))))
+	{
+		value |= ~0u << numBits;
+	}
+	return static_cast<int>(value);
+}
+
+// ----------------------------------------------------------------------------
+SwfReader::SwfReader() :
+	m_data(NULL),
+	m_size(0),
+	m_signature(0),
+	m_version(0),
+	m_frameRate(0),
+	m_declaredFrameCount(0),
+	m_headerSize(0),
+	m_finalBlockBit(0),
+	m_finalBlockOffset(0),
+	m_complete(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+bool SwfReader::isDefinitionTag(unsigned int code)
+{
+	// The body of these starts with the CharacterID they define
+	switch (code)
+	{
+	case SwfWriter::SwfTag_DefineShape:
+	case SwfWriter::SwfTag_DefineBits:
+	case SwfWriter::SwfTag_DefineButton:
+	case SwfWriter::SwfTag_DefineFont:
+	case SwfWriter::SwfTag_DefineText:
+	case SwfWriter::SwfTag_DefineSound:
+	case SwfWriter::SwfTag_DefineBitsLossless:
+	case SwfWriter::SwfTag_DefineBitsJPEG2:
+	case SwfWriter::SwfTag_DefineShape2:
+	case SwfWriter::SwfTag_DefineShape3:
+	case SwfWriter::SwfTag_DefineText2:
+	case SwfWriter::SwfTag_DefineButton2:
+	case SwfWriter::SwfTag_DefineBitsJPEG3:
+	case SwfWriter::SwfTag_DefineBitsLossless2:
+	case SwfWriter::SwfTag_DefineEditText:
+	case SwfWriter::SwfTag_DefineSprite:
+	case SwfWriter::SwfTag_DefineMorphShape:
+	case SwfWriter::SwfTag_DefineFont2:
+	case SwfWriter::SwfTag_DefineVideoStream:
+	case SwfWriter::SwfTag_DefineFont3:
+	case SwfWriter::SwfTag_DefineShape4:
+	case SwfWriter::SwfTag_DefineMorphShape2:
+	case SwfWriter::SwfTag_DefineBinaryData:
+	case SwfWriter::SwfTag_DefineBitsJPEG4:
+	case SwfWriter::SwfTag_DefineFont4:
+		return true;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfReader::open(const std::wstring& filename)
+{
+	close();
+
+	m_file.reset(new MappedFile());
+	if (!m_file->open(filename) || m_file->getSize() < 8)
+	{
+		close();
+		return false;
+	}
+
+	const unsigned char* data = m_file->getData();
+	unsigned long size = m_file->getSize();
+	m_signature = static_cast<char>(data[0]);
+	if (data[1] != 'W' || data[2] != 'S')
+	{
+		close();
+		return false;
+	}
+
+	if (m_signature == 'F')
+	{
+		m_data = data;
+		m_size = size;
+	}
+	else if (!decompress(data, size, readLong(data + 4)))
+	{
+		close();
+		return false;
+	}
+	else
+	{
+		// The compressed file is not needed any more
+		m_file.reset();
+	}
+
+	unsigned long pos = 0;
+	if (!readHeader(pos))
+	{
+		close();
+		return false;
+	}
+	buildIndex(pos);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void SwfReader::close()
+{
+	m_file.reset();
+	std::vector<unsigned char>().swap(m_inflated);
+	m_data = NULL;
+	m_size = 0;
+	m_signature = 0;
+	m_version = 0;
+	m_frameRect = SwfWriter::Rect();
+	m_frameRate = 0;
+	m_declaredFrameCount = 0;
+	m_headerSize = 0;
+	m_finalBlockBit = 0;
+	m_finalBlockOffset = 0;
+	m_complete = false;
+	TagList().swap(m_tags);
+	std::vector<unsigned int>().swap(m_frames);
+	std::vector<unsigned int>().swap(m_characters);
+}
+
+// ----------------------------------------------------------------------------
+static void growOutput(std::vector<unsigned char>& output)
+{
+	output.resize(output.size() + std::max(output.size() / 2, static_cast<size_t>(0x10000)));
+}
+
+// ----------------------------------------------------------------------------
+bool SwfReader::decompress(const unsigned char* data, unsigned long size, unsigned long fileLength)
+{
+	// The header length sizes the buffer but is not trusted beyond that,
+	// progressive writers may only have estimated it
+	m_inflated.resize(std::max(8ul, std::min(fileLength, size * 64 + 0x10000)));
+	std::copy(data, data + 8, m_inflated.begin());
+	unsigned long outSize = 8;
+
+	if (m_signature == 'C')
+	{
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if (inflateInit(&stream) != Z_OK)
+			return false;
+
+		// Stops on block boundaries to note where the last block starts, the
+		// zlib header counts as the end of a block
+		stream.next_in = const_cast<unsigned char*>(data + 8);
+		stream.avail_in = size - 8;
+		int result = Z_OK;
+		while (result == Z_OK)
+		{
+			if (outSize == m_inflated.size())
+			{
+				growOutput(m_inflated);
+			}
+			stream.next_out = &m_inflated[outSize];
+			stream.avail_out = m_inflated.size() - outSize;
+			result = inflate(&stream, Z_BLOCK);
+			outSize = m_inflated.size() - stream.avail_out;
+
+			if ((stream.data_type & 128) && !(stream.data_type & 64))
+			{
+				unsigned long long consumed = (size - 8) - stream.avail_in;
+				m_finalBlockBit = consumed * 8 - (stream.data_type & 7);
+				m_finalBlockOffset = outSize;
+			}
+		}
+		// A truncated file keeps what could be inflated, as an FWS file would
+		bool truncated = result == Z_BUF_ERROR && stream.avail_in == 0;
+		inflateEnd(&stream);
+		if (result != Z_STREAM_END && !truncated)
+			return false;
+	}
+#ifdef SWF_USE_LZMA
+	else if (m_signature == 'Z' && size >= 17)
+	{
+		// Rebuilt as an .lzma ("alone") stream: the properties, the
+		// uncompressed size SWF leaves out, then the data
+		unsigned char header[13];
+		std::copy(data + 12, data + 17, header);
+		unsigned long long uncompressed = fileLength - 8;
+		for (unsigned int i = 0; i < 8; ++i)
+		{
+			header[5 + i] = static_cast<unsigned char>(uncompressed >> (8 * i));
+		}
+
+		lzma_stream stream = LZMA_STREAM_INIT;
+		if (lzma_alone_decoder(&stream, UINT64_MAX) != LZMA_OK)
+			return false;
+
+		// The output grows as for zlib, LZMA easily compresses past the
+		// initial estimate
+		stream.next_in = header;
+		stream.avail_in = sizeof(header);
+		bool inHeader = true;
+		lzma_ret result = LZMA_OK;
+		while (result == LZMA_OK)
+		{
+			if (inHeader && stream.avail_in == 0)
+			{
+				stream.next_in = data + 17;
+				stream.avail_in = size - 17;
+				inHeader = false;
+			}
+			if (outSize == m_inflated.size())
+			{
+				growOutput(m_inflated);
+			}
+			stream.next_out = &m_inflated[outSize];
+			stream.avail_out = m_inflated.size() - outSize;
+			result = lzma_code(&stream, inHeader ? LZMA_RUN : LZMA_FINISH);
+			outSize = m_inflated.size() - stream.avail_out;
+		}
+		lzma_end(&stream);
+		if (result != LZMA_STREAM_END)
+			return false;
+	}
+#endif
+	else
+	{
+		return false;
+	}
+
+	m_inflated.resize(outSize);
+	m_data = &m_inflated[0];
+	m_size = outSize;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfReader::readHeader(unsigned long& pos)
+{
+	// Signature, version and length, then the frame RECT, rate and count
+	m_version = m_data[3];
+	pos = 8;
+	if (m_size < pos + 1)
+		return false;
+
+	unsigned int numBits = m_data[pos] >> 3;
+	unsigned long rectSize = (5 + 4 * numBits + 7) / 8;
+	if (m_size < pos + rectSize + 4)
+		return false;
+
+	unsigned long bitPos = pos * 8 + 5;
+	m_frameRect.xmin = readBits(m_data, bitPos, numBits);
+	m_frameRect.xmax = readBits(m_data, bitPos, numBits);
+	m_frameRect.ymin = readBits(m_data, bitPos, numBits);
+	m_frameRect.ymax = readBits(m_data, bitPos, numBits);
+	pos += rectSize;
+
+	m_frameRate = readWord(m_data + pos);
+	m_declaredFrameCount = readWord(m_data + pos + 2);
+	pos += 4;
+	m_headerSize = pos;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void SwfReader::buildIndex(unsigned long pos)
+{
+	// Tags average a few dozen bytes in typical files
+	m_tags.reserve(std::min<unsigned long>(m_size / 32, 1ul << 20) + 16);
+	m_frames.reserve(m_declaredFrameCount + 1);
+	m_frames.push_back(0);
+
+	while (pos + 2 <= m_size)
+	{
+		unsigned int header = readWord(m_data + pos);
+		unsigned long length = header & 0x3f;
+		pos += 2;
+		if (length == 0x3f)
+		{
+			if (pos + 4 > m_size)
+				break;
+			length = readLong(m_data + pos);
+			pos += 4;
+		}
+		if (length > m_size - pos)
+			break;		// Truncated, the tags so far stay usable
+
+		Tag tag;
+		tag.code = static_cast<unsigned short>(header >> 6);
+		tag.characterID = 0;
+		tag.offset = static_cast<unsigned int>(pos);
+		tag.length = static_cast<unsigned int>(length);
+		if (length >= 2 && isDefinitionTag(tag.code))
+		{
+			tag.characterID = static_cast<CharacterID>(readWord(m_data + pos));
+			if (tag.characterID >= m_characters.size())
+			{
+				m_characters.resize(std::max<unsigned long>(tag.characterID + 1, m_characters.size() * 2), 0);
+			}
+			m_characters[tag.characterID] = m_tags.size() + 1;
+		}
+		m_tags.push_back(tag);
+		pos += length;
+
+		if (tag.code == SwfWriter::SwfTag_ShowFrame)
+		{
+			m_frames.push_back(m_tags.size());
+		}
+		else if (tag.code == SwfWriter::SwfTag_End)
+		{
+			m_complete = true;
+			break;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+bool SwfReader::getFrameTags(unsigned int frame, unsigned long& first, unsigned long& last) const
+{
+	if (frame >= getFrameCount())
+		return false;
+
+	first = m_frames[frame];
+	last = m_frames[frame + 1];
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+const SwfReader::Tag* SwfReader::findCharacter(CharacterID id) const
+{
+	if (id >= m_characters.size() || m_characters[id] == 0)
+		return NULL;
+	return &m_tags[m_characters[id] - 1];
+}
+
+// ----------------------------------------------------------------------------
+SwfReader::CharacterID SwfReader::getMaxCharacterID() const
+{
+	// 0 if nothing is defined
+	unsigned long id = m_characters.size();
+	while (id > 0 && m_characters[id - 1] == 0)
+	{
+		--id;
+	}
+	return static_cast<CharacterID>(id > 0 ? id - 1 : 0);
+}
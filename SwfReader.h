@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "SwfWriter.h"
+#include "MappedFile.h"
+
+// ----------------------------------------------------------------------------
+// Read-only access to the tags of a SWF file. FWS files are used in place
+// through a mapping, CWS and ZWS files are decompressed once into memory.
+// open() makes a single pass over the main timeline and indexes every tag, so
+// character definitions and frames are found without parsing again. The tags
+// of sprites are part of their DefineSprite body and are not indexed.
+class SwfReader
+{
+public:
+	typedef SwfWriter::FlashTagCode FlashTagCode;
+	typedef SwfWriter::CharacterID CharacterID;
+
+	// ------------------------------------------------------------------------
+	// 12 bytes per tag, SWF lengths and offsets are 32-bit anyway
+	struct Tag
+	{
+		unsigned short code;
+		CharacterID characterID;	// Only meaningful for definition tags
+		unsigned int offset;		// Of the body, from the start of the uncompressed file
+		unsigned int length;
+	};
+	typedef std::vector<Tag> TagList;
+
+private:
+	MappedFilePtr m_file;
+	std::vector<unsigned char> m_inflated;
+	const unsigned char* m_data;
+	unsigned long m_size;
+	char m_signature;
+	unsigned char m_version;
+	SwfWriter::Rect m_frameRect;
+	unsigned short m_frameRate;			// 8.8 fixed point
+	unsigned short m_declaredFrameCount;
+	unsigned long m_headerSize;
+	unsigned long long m_finalBlockBit;		// CWS: start of the last deflate block, in bits from the zlib header
+	unsigned long m_finalBlockOffset;		// CWS: where the data of that block starts in the file
+	bool m_complete;					// The End tag was reached
+	TagList m_tags;
+	std::vector<unsigned int> m_frames;			// First tag of each frame, then the end of the last
+	std::vector<unsigned int> m_characters;		// Tag index + 1 by CharacterID, 0 if undefined
+
+private:
+	SwfReader(const SwfReader&);
+	SwfReader& operator=(const SwfReader&);
+
+	bool decompress(const unsigned char* data, unsigned long size, unsigned long fileLength);
+	bool readHeader(unsigned long& pos);
+	void buildIndex(unsigned long pos);
+
+public:
+	SwfReader();
+
+	bool open(const std::wstring& filename);
+	void close();
+
+	static bool isDefinitionTag(unsigned int code);
+
+	inline char getSignature() const { return m_signature; }
+	inline unsigned char getVersion() const { return m_version; }
+	inline const SwfWriter::Rect& getFrameRect() const { return m_frameRect; }
+	inline float getFrameRate() const { return m_frameRate / 256.0f; }
+	inline unsigned short getFixedFrameRate() const { return m_frameRate; }	// 8.8 fixed point
+	inline unsigned short getDeclaredFrameCount() const { return m_declaredFrameCount; }
+	inline unsigned long getHeaderSize() const { return m_headerSize; }
+	inline bool isComplete() const { return m_complete; }
+
+	// Uncompressed file, header included
+	inline const unsigned char* getData() const { return m_data; }
+	inline unsigned long getSize() const { return m_size; }
+
+	inline const TagList& getTags() const { return m_tags; }
+	inline unsigned long getTagCount() const { return m_tags.size(); }
+	inline const Tag& getTag(unsigned long index) const { return m_tags[index]; }
+	inline const unsigned char* getTagData(const Tag& tag) const { return m_data + tag.offset; }
+
+	// Main timeline frames, each ends with its ShowFrame tag
+	inline unsigned int getFrameCount() const { return m_frames.empty() ? 0 : m_frames.size() - 1; }
+	bool getFrameTags(unsigned int frame, unsigned long& first, unsigned long& last) const;
+
+	// The tag defining a character, NULL if there is none
+	const Tag* findCharacter(CharacterID id) const;
+	CharacterID getMaxCharacterID() const;
+
+	// A CWS file can be continued from the start of its last deflate block
+	// without compressing what comes before again
+	inline unsigned long long getFinalBlockBit() const { return m_finalBlockBit; }
+	inline unsigned long getFinalBlockOffset() const { return m_finalBlockOffset; }
+};
@@ -1,97 +1,574 @@
+#include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "Compress.h"
 #include "SwfWriter.h"
+#include "SwfReader.h"
+#include "MappedFile.h"
+#include "MP3Stream.h"
+#include "ADPCMStream.h"
+#include "ThreadPool.h"
 
 // ----------------------------------------------------------------------------
 typedef std::vector<unsigned char> Buffer;
 
 // ----------------------------------------------------------------------------
 // Tag codes that the player requires to be large tag headtypes
-inline bool IS_FLASH_LARGE_TAG_CODE(SwfWriter::FlashTagCode c) 
+constexpr bool IS_FLASH_LARGE_TAG_CODE(SwfWriter::FlashTagCode c) 
 {
 	return	(c == SwfWriter::SwfTag_DefineBits)				||
 			(c == SwfWriter::SwfTag_DefineBitsJPEG2)		||
 			(c == SwfWriter::SwfTag_DefineBitsJPEG3)		||
 			(c == SwfWriter::SwfTag_DefineBitsLossless)		||
 			(c == SwfWriter::SwfTag_DefineBitsLossless2)	||
-			(c == SwfWriter::SwfTag_SoundStreamBlock);
+			(c == SwfWriter::SwfTag_SoundStreamBlock)		||
+			(c == SwfWriter::SwfTag_VideoFrame);
 }
 
 // ----------------------------------------------------------------------------
-// Count bits needed to represent an unsigned value.
-// In practice we're detecting the position of the leftmost bit set to 1.
-static unsigned int countRequiredBits(unsigned int value)
+static void storeWord(unsigned char* dst, unsigned short value)
 {
-	unsigned int numBits = 0;
-	while (value & ~0xF)
+	dst[0] = static_cast<unsigned char>(value);
+	dst[1] = static_cast<unsigned char>(value >> 8);
+}
+
+// ----------------------------------------------------------------------------
+static void storeLong(unsigned char* dst, unsigned long value)
+{
+	dst[0] = static_cast<unsigned char>(value);
+	dst[1] = static_cast<unsigned char>(value >> 8);
+	dst[2] = static_cast<unsigned char>(value >> 16);
+	dst[3] = static_cast<unsigned char>(value >> 24);
+}
+
+// ----------------------------------------------------------------------------
+// Complete record of a tag whose body size is known at compile time. The header
+// form is picked by the compiler and the record goes out with one writeRecord.
+template <SwfWriter::FlashTagCode Tag, unsigned long Size>
+class FixedTagRecord
+{
+public:
+	enum
+	{
+		HEADER_SIZE = (Size < 0x3f && !IS_FLASH_LARGE_TAG_CODE(Tag)) ? 2 : 6,
+		RECORD_SIZE = HEADER_SIZE + Size
+	};
+
+private:
+	unsigned char m_data[RECORD_SIZE];
+
+public:
+	FixedTagRecord()
 	{
-		value >>= 4;
-		numBits += 4;
+		if (HEADER_SIZE == 2)
+		{
+			storeWord(m_data, static_cast<unsigned short>((Tag << 6) | Size));
+		}
+		else
+		{
+			storeWord(m_data, static_cast<unsigned short>((Tag << 6) | 0x3f));
+			storeLong(m_data + 2, Size);
+		}
 	}
-	while (value)
+
+	inline SwfWriter::FlashTagCode getTag() const { return Tag; }
+	inline unsigned char* getBody() { return m_data + HEADER_SIZE; }
+	inline const unsigned char* getData() const { return m_data; }
+	inline unsigned long getSize() const { return RECORD_SIZE; }
+};
+
+// ----------------------------------------------------------------------------
+// Times the streaming compressor. It writes its output to the file as it goes,
+// that part is I/O and is taken out again.
+class SwfWriter::StreamStatsTimer
+{
+private:
+	SwfWriter* m_writer;
+	StatsTimer m_timer;
+	double m_ioTime;
+
+public:
+	explicit StreamStatsTimer(SwfWriter* writer) :
+		m_writer(writer),
+		m_timer(writer->collectStats()),
+		m_ioTime(m_timer.isActive() ? writer->getIOTime() : 0)
 	{
-		value >>= 1;
-		++numBits;
 	}
-	return numBits;
-}
+
+	~StreamStatsTimer()
+	{
+		if (m_timer.isActive())
+		{
+			m_writer->addCompressTime(m_timer.getElapsed() - (m_writer->getIOTime() - m_ioTime));
+		}
+	}
+};
 
 // ----------------------------------------------------------------------------
 SwfWriter::SwfWriter() : 
 	m_compressSwf(true),
+	m_documentCompressed(true),
+	m_compressionTier(Compressor::TIER_BEST),
+	m_compressor(&m_zlibCompressor),
+	m_threadPool(NULL),
+	m_assetIndex(&m_localAssetIndex),
+	m_deduplicateAssets(true),
+	m_reuse(false),
+	m_bufferAllocationCount(0),
 	m_nextCharacterID(0),
-	m_frameRate(30),
+	m_version(6),
+	m_documentVersion(6),
+	m_frameRate(30 << 8),
 	m_frameCount(0),
-	m_sndStreamFixupPos(0)
+	m_sndStreamFixupPos(0),
+	m_sndStreamFixupDepth(0),
+	m_sndStreamFixupSize(0),
+	m_headerEnd(0),
+	m_streamStarted(false),
+	m_progressive(false),
+	m_declaredFrameCount(0),
+	m_declaredFileLength(0)
 {
 }
 
 // ----------------------------------------------------------------------------
 SwfWriter::~SwfWriter()
 {
+	// The writer thread may still be using the compressor
+	waitClose();
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::close()
+{
+	if (!isStreaming())
+	{
+		fixupHeader();
+	}
+	bool success = FileWriter::close();
+	resetDocument();
+	return success;
+}
+
+// ----------------------------------------------------------------------------
+FileWriter::CloseResult SwfWriter::closeAsync()
+{
+	// The compressor and its settings are used on the writer thread until the
+	// result is ready, the setters wait for it
+	if (!isStreaming())
+	{
+		fixupHeader();
+	}
+	CloseResult result = FileWriter::closeAsync();
+	resetDocument();
+	return result;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::openAppend(const std::wstring& filename)
+{
+	// Opens a finished file to add tags where its End tag is, the CharacterIDs,
+	// frame count, version, frame rect and rate go on from the file. The
+	// document always streams and keeps the format of the file. FWS files are
+	// written in place. A CWS file written by a streaming writer (its header
+	// in a stored block) is recompressed from the start of its last deflate
+	// block only. Any other compressed file is written again as such a CWS
+	// file, so that only the first append costs a full compression.
+	waitClose();
+
+	SwfReader reader;
+	if (!reader.open(filename) || !reader.isComplete())
+		return false;
+
+	// The End tag and whatever trails it are written again
+	const SwfReader::TagList& tags = reader.getTags();
+	unsigned long headerEnd = reader.getHeaderSize();
+	unsigned long endPos = (tags.size() > 1) ? tags[tags.size() - 2].offset + tags[tags.size() - 2].length : headerEnd;
+	bool compressed = reader.getSignature() != 'F';
+
+	unsigned long resumePos = 0;		// Where the document is taken up, in the uncompressed file
+	unsigned long filePos = 0;			// and in the file on disk
+	if (!compressed)
+	{
+		resumePos = endPos;
+		filePos = endPos;
+	}
+	else if (reader.getSignature() == 'C')
+	{
+		// Needs the stored header and a 32K window for the dictionary
+		MappedFile file;
+		unsigned long long bit = reader.getFinalBlockBit();
+		unsigned long offset = reader.getFinalBlockOffset();
+		unsigned int prefixSize = headerEnd - 8;
+		if (file.open(filename) && file.getSize() > 8 + 7 + bit / 8 && offset >= headerEnd && offset <= endPos)
+		{
+			const unsigned char* zlib = file.getData() + 8;
+			if (zlib[0] == 0x78 && zlib[2] == 0 &&
+				zlib[3] == static_cast<unsigned char>(prefixSize) && zlib[4] == static_cast<unsigned char>(prefixSize >> 8) &&
+				zlib[5] == static_cast<unsigned char>(~prefixSize) && zlib[6] == static_cast<unsigned char>(~prefixSize >> 8))
+			{
+				m_stream.setLevel(ZLIBCompressor::getTierLevel(m_compressionTier));
+				if (m_stream.resume(this, reader.getData() + 8, offset - 8, prefixSize, zlib[bit / 8], static_cast<unsigned int>(bit % 8)))
+				{
+					resumePos = offset;
+					filePos = static_cast<unsigned long>(8 + bit / 8);
+				}
+			}
+		}
+	}
+
+	m_documentVersion = reader.getVersion();
+	m_documentCompressed = compressed;
+	m_frameRect = reader.getFrameRect();
+	m_frameRate = reader.getFixedFrameRate();
+	m_frameCount = reader.getFrameCount();
+	m_nextCharacterID = reader.getMaxCharacterID();
+	m_headerEnd = headerEnd;
+	m_streamStarted = compressed && resumePos > 0;
+
+	// The mapping of an FWS file goes before it is written to, compressed
+	// files were read into memory
+	if (!compressed)
+	{
+		reader.close();
+	}
+	if (!reopen(filename, filePos, resumePos))
+	{
+		resetDocument();
+		return false;
+	}
+	if (endPos > resumePos)
+	{
+		writeData(reader.getData() + resumePos, endPos - resumePos);
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setProgressive(bool progressive, unsigned short frameCount, unsigned long fileLength)
+{
+	// Streaming where every main timeline frame goes out as soon as it is
+	// shown. The header carries the declared frame count and file length and
+	// is never patched, so any sink works. Only meaningful before open().
+	waitClose();
+	m_progressive = progressive;
+	m_declaredFrameCount = frameCount;
+	m_declaredFileLength = fileLength;
+	if (m_progressive)
+	{
+		setStreaming(true);
+	}
+}
+
+// ----------------------------------------------------------------------------
+const char* SwfWriter::getTagName(unsigned int code)
+{
+	switch (code)
+	{
+	case SwfTag_End:					return "End";
+	case SwfTag_ShowFrame:				return "ShowFrame";
+	case SwfTag_DefineShape:			return "DefineShape";
+	case SwfTag_DefineBits:				return "DefineBits";
+	case SwfTag_DefineButton:			return "DefineButton";
+	case SwfTag_SetBackgroundColor:		return "SetBackgroundColor";
+	case SwfTag_DefineFont:				return "DefineFont";
+	case SwfTag_DefineText:				return "DefineText";
+	case SwfTag_DoAction:				return "DoAction";
+	case SwfTag_DefineSound:			return "DefineSound";
+	case SwfTag_SoundStreamHead:		return "SoundStreamHead";
+	case SwfTag_SoundStreamBlock:		return "SoundStreamBlock";
+	case SwfTag_DefineBitsLossless:		return "DefineBitsLossless";
+	case SwfTag_DefineBitsJPEG2:		return "DefineBitsJPEG2";
+	case SwfTag_DefineShape2:			return "DefineShape2";
+	case SwfTag_PlaceObject2:			return "PlaceObject2";
+	case SwfTag_RemoveObject2:			return "RemoveObject2";
+	case SwfTag_DefineShape3:			return "DefineShape3";
+	case SwfTag_DefineText2:			return "DefineText2";
+	case SwfTag_DefineButton2:			return "DefineButton2";
+	case SwfTag_DefineBitsJPEG3:		return "DefineBitsJPEG3";
+	case SwfTag_DefineBitsLossless2:	return "DefineBitsLossless2";
+	case SwfTag_DefineEditText:			return "DefineEditText";
+	case SwfTag_DefineSprite:			return "DefineSprite";
+	case SwfTag_DefineMorphShape:		return "DefineMorphShape";
+	case SwfTag_DefineFont2:			return "DefineFont2";
+	case SwfTag_DefineExportAssets:		return "DefineExportAssets";
+	case SwfTag_DefineVideoStream:		return "DefineVideoStream";
+	case SwfTag_VideoFrame:				return "VideoFrame";
+	case SwfTag_DefineFont3:			return "DefineFont3";
+	case SwfTag_DefineShape4:			return "DefineShape4";
+	case SwfTag_DefineMorphShape2:		return "DefineMorphShape2";
+	case SwfTag_DefineBinaryData:		return "DefineBinaryData";
+	case SwfTag_DefineBitsJPEG4:		return "DefineBitsJPEG4";
+	case SwfTag_DefineFont4:			return "DefineFont4";
+	}
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+std::string SwfWriter::getStatsJSON()
+{
+	return getStats().toJSON(&SwfWriter::getTagName);
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setReuse(bool reuse)
+{
+	// Keeps the compressed output buffer and the zlib state from one file to
+	// the next, for processes writing many files with the same writer
+	waitClose();
+	m_reuse = reuse;
+	if (!m_reuse)
+	{
+		releaseCompressionState();
+		m_stream.releaseState();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::releaseCompressionState()
+{
+	// Runs on the writer thread after closeAsync(), the stream is only used
+	// by streaming writers and released by finishStream()
+	if (!m_reuse)
+	{
+		FileWriter::Buffer().swap(m_compressedBuffer);
+		m_zlibCompressor.releaseState();
+	}
+}
+
+// ----------------------------------------------------------------------------
+unsigned long SwfWriter::getAllocationCount() const
+{
+	// zlib state and compressed output growth of this writer. Buffer chunks
+	// are counted by their ChunkPool.
+	return m_zlibCompressor.getAllocationCount() + m_bitmapCompressor.getAllocationCount() +
+		   m_stream.getAllocationCount() + m_bufferAllocationCount;
 }
 
 // ----------------------------------------------------------------------------
-void SwfWriter::close()
+void SwfWriter::resetDocument()
 {
-	fixupHeader();
-	FileWriter::close();
+	// Ready for the next open(), the settings are kept
+	m_nextCharacterID = 0;
+	m_frameCount = 0;
+	m_sndStreamFixupPos = 0;
+	m_sndStreamFixupDepth = 0;
+	m_headerEnd = 0;
+	m_streamStarted = false;
+	m_documentVersion = m_version;
+	m_documentCompressed = m_compressSwf;
+	m_assets.clear();
+
+	// Bitmaps are done on the calling thread, unlike the body compression
+	if (!m_reuse)
+	{
+		FileWriter::Buffer().swap(m_bitmapBuffer);
+		m_bitmapCompressor.releaseState();
+	}
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::setCompression(bool compress)
 {
+	waitClose();
 	m_compressSwf = compress;
+	m_documentCompressed = compress;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setCompressionTier(Compressor::Tier tier)
+{
+	waitClose();
+	m_compressionTier = tier;
+	m_compressor->setTier(tier);
+	m_bitmapCompressor.setTier(tier);
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setCompressor(Compressor* compressor)
+{
+	// Not owned, NULL goes back to the built-in zlib compressor
+	waitClose();
+	m_compressor = compressor ? compressor : &m_zlibCompressor;
+	m_compressor->setTier(m_compressionTier);
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setThreadPool(ThreadPool* pool)
+{
+	waitClose();
+	m_threadPool = pool;
+	m_zlibCompressor.setThreadPool(pool);
+	m_bitmapCompressor.setThreadPool(pool);
 }
 
 // ----------------------------------------------------------------------------
-void SwfWriter::writeBuffer()
+bool SwfWriter::writeBuffer(ClosedFile& file)
 {
 	if (m_compressSwf)
 	{
-		FileWriter::Buffer compressedBuffer;
+		FileWriter::Buffer& compressedBuffer = m_compressedBuffer;
+		size_t capacity = compressedBuffer.capacity();
+
+		// The compressor walks the body in place, referenced payloads included.
+		// Already compressed payloads are flagged so they can be stored as is.
+		DataSpanList spans;
+		getSpans(file, 8, file.buffer.getEnd(), spans);
 
-		unsigned int dataBufferSize = getFileSize() - 8;
-		ZLIBCompressor compressor;
-		compressor.compress(getBufferAtPos(8), dataBufferSize, compressedBuffer);
+		unsigned int dataBufferSize = file.buffer.getEnd() - 8;
+		StatsTimer timer(collectStats());
+		m_compressor->compress(spans, compressedBuffer);
+		if (timer.isActive())
+		{
+			addCompressTime(timer.getElapsed());
+		}
+		if (compressedBuffer.capacity() > capacity)
+		{
+			++m_bufferAllocationCount;
+		}
+
+		// LZMA data is preceded by its own length and needs at least SWF 13
+		char signature = m_compressor->getSignature();
+		unsigned int headerSize = (signature == 'Z') ? 12 : 8;
 
 		unsigned int compressedBufferSize = compressedBuffer.size();
-		if (compressedBufferSize < dataBufferSize)
+		if (compressedBufferSize > 0 && compressedBufferSize + headerSize - 8 < dataBufferSize)
+		{
+			OutputSink::File output;
+			unsigned char* header = output.prefix;
+			file.buffer.read(0, header, 8);
+			header[0] = signature;
+			if (signature == 'Z')
+			{
+				header[3] = std::max<unsigned char>(header[3], 13);
+				storeLong(header + 8, compressedBufferSize - 5);	// excludes the LZMA properties
+			}
+			output.prefixSize = headerSize;
+
+			// A memory sink takes the compressed buffer with it
+			output.spans.push_back(DataSpan(&compressedBuffer[0], compressedBufferSize));
+			output.data = &compressedBuffer;
+			bool success = writeFile(file, output);
+			releaseCompressionState();
+			return success;
+		}
+	}
+
+	releaseCompressionState();
+	return FileWriter::writeBuffer(file);
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::writeStreamData(unsigned long pos, const DataSpanList& spans)
+{
+	if (!m_documentCompressed)
+	{
+		FileWriter::writeStreamData(pos, spans);
+		return;
+	}
+
+	// Streamed output is always zlib, only the tier of the selected compressor applies.
+	for (DataSpanList::const_iterator i = spans.begin(); i != spans.end(); ++i)
+	{
+		const unsigned char* data = i->data;
+		unsigned long size = i->size;
+
+		// The signature, version and file length are never compressed
+		if (pos < 8)
+		{
+			unsigned long count = std::min(size, 8 - pos);
+			unsigned char prefix[8];
+			std::copy(data, data + count, prefix);
+			if (pos == 0)
+			{
+				prefix[0] = 'C';
+			}
+			writeFileData(prefix, count);
+			pos += count;
+			data += count;
+			size -= count;
+		}
+
+		// The rest of the header goes into a stored block so the frame count can still
+		// be patched at close. Flushes only happen on tag boundaries, so it arrives whole.
+		if (size > 0 && !m_streamStarted)
+		{
+			unsigned long count = (pos < m_headerEnd) ? m_headerEnd - pos : 0;
+			assert(count <= size);
+			m_stream.setLevel(ZLIBCompressor::getTierLevel(m_compressionTier));
+			StreamStatsTimer timer(this);
+			m_stream.begin(this, data, count);
+			m_streamStarted = true;
+			pos += count;
+			data += count;
+			size -= count;
+		}
+
+		if (size > 0)
+		{
+			StreamStatsTimer timer(this);
+			m_stream.write(data, size, i->stored);
+			pos += size;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::finishStream()
+{
+	// Nothing has gone out before the header, so only the version, length and frame
+	// count need patching. Progressive output declared them up front, unless it
+	// was appended to.
+	bool patchHeader = !m_progressive || isReopened();
+	unsigned char versionAndSize[5];
+	versionAndSize[0] = m_documentVersion;
+	storeLong(versionAndSize + 1, getFileSize());
+	if (patchHeader)
+	{
+		writeFileDataAt(3, versionAndSize, 5);
+	}
+
+	unsigned char frameCount[2];
+	frameCount[0] = static_cast<unsigned char>(m_frameCount);
+	frameCount[1] = static_cast<unsigned char>(m_frameCount >> 8);
+
+	if (patchHeader && collectStats())
+	{
+		getStatsRecord().headerFixups += 1;
+	}
+
+	if (m_documentCompressed)
+	{
+		StreamStatsTimer timer(this);
+		if (!m_streamStarted)
+		{
+			m_stream.setLevel(ZLIBCompressor::getTierLevel(m_compressionTier));
+			m_stream.begin(this);
+			m_streamStarted = true;
+		}
+		if (patchHeader && m_headerEnd > 8)
 		{
-			resizeFile(compressedBufferSize + 8);
-			setPosition(8);
-			writeData(compressedBuffer);
-			/*
-			m_buffer.resize(compressedBufferSize + 8);
-			std::copy(compressedBuffer.begin(), compressedBuffer.end(), m_buffer.begin()+8);
-			*/
+			unsigned long offset = m_stream.patchStoredPrefix(m_headerEnd - 2 - 8, frameCount, 2);
+			writeFileDataAt(8 + offset, frameCount, 2);
 		}
-		setPosition(0);
-		writeByte('C');
-		setPosition(getFileSize());
+		m_stream.finish();
+		if (!m_reuse)
+		{
+			m_stream.releaseState();
+		}
+	}
+	else if (patchHeader && m_headerEnd > 8)
+	{
+		writeFileDataAt(m_headerEnd - 2, frameCount, 2);
 	}
+}
 
-	FileWriter::writeBuffer();
+// ----------------------------------------------------------------------------
+void SwfWriter::writeCompressed(const unsigned char* data, unsigned int size)
+{
+	writeFileData(data, size);
 }
 
 // ----------------------------------------------------------------------------
@@ -103,10 +580,41 @@ void SwfWriter::setFrameRect(int xmin, int xmax, int ymin, int ymax)
 	m_frameRect.ymax = ymax;
 }
 
+// ----------------------------------------------------------------------------
+void SwfWriter::setDeduplicateAssets(bool deduplicate)
+{
+	// Defining the same asset file content again returns the first CharacterID
+	m_deduplicateAssets = deduplicate;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setAssetIndex(AssetIndex* index)
+{
+	// Not owned, NULL goes back to an index private to this writer
+	m_assetIndex = index ? index : &m_localAssetIndex;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::setVersion(unsigned char version)
+{
+	// Tags that need a later version raise it for their document only
+	waitClose();
+	m_version = version;
+	m_documentVersion = version;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::requireVersion(unsigned char version)
+{
+	// The header is patched at close. Progressive output has sent it already,
+	// such writers need setVersion() up front.
+	m_documentVersion = std::max(m_documentVersion, version);
+}
+
 // ----------------------------------------------------------------------------
 void SwfWriter::setFrameRate(unsigned int fps)
 {
-	m_frameRate = fps;
+	m_frameRate = static_cast<unsigned short>(fps << 8);
 }
 
 // ----------------------------------------------------------------------------
@@ -120,7 +628,7 @@ void SwfWriter::writeColor(const Color& color)
 // ----------------------------------------------------------------------------
 void SwfWriter::writeRect(const Rect& rect)
 {
-	unsigned int numBits = countRequiredBits(rect.findGreatestAbsValue()) + 1; // include the sign bit
+	unsigned int numBits = BitWriter::countRequiredBits(rect.findGreatestAbsValue()) + 1; // include the sign bit
 	writeBits(numBits, 5);
 	writeBits(rect.xmin, numBits);
 	writeBits(rect.xmax, numBits);
@@ -132,20 +640,15 @@ void SwfWriter::writeRect(const Rect& rect)
 // ----------------------------------------------------------------------------
 void SwfWriter::writeRecordHeaderStart(FlashTagCode tag)
 {
-	TagInfo tagInfo(true, tag, getPosition());
-
-	// Use long record header
-	writeWord((tag << 6) | 0x3f);
-	writeLong(0);	// Place holder
-
-	m_tagInfoList.push_back(tagInfo);
+	// The size is not known yet, the body is built in a scratch buffer and
+	// the header is written in front of it by writeRecordHeaderEnd()
+	beginScratch();
+	m_tagInfoList.push_back(TagInfo(true, tag));
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::writeRecordHeaderStart(FlashTagCode tag, unsigned long size)
 {
-	TagInfo tagInfo(false, tag, getPosition());
-
 	if (size < 0x3f && !IS_FLASH_LARGE_TAG_CODE(tag))
 	{
 		// Use short record header
@@ -159,7 +662,11 @@ void SwfWriter::writeRecordHeaderStart(FlashTagCode tag, unsigned long size)
 		writeLong(size);
 	}
 
-	m_tagInfoList.push_back(tagInfo);
+	if (collectStats())
+	{
+		countTag(tag, (size < 0x3f && !IS_FLASH_LARGE_TAG_CODE(tag) ? 2 : 6) + size);
+	}
+	m_tagInfoList.push_back(TagInfo(false, tag));
 }
 
 // ----------------------------------------------------------------------------
@@ -168,31 +675,83 @@ void SwfWriter::writeRecordHeaderEnd()
 	TagInfo tagInfo = m_tagInfoList.back();
 	m_tagInfoList.pop_back();
 
-	if (tagInfo.requireFixup)
+	if (tagInfo.scratch)
 	{
-		unsigned long dataBegin = tagInfo.begin + 6;
-		unsigned long end = getPosition();
-		unsigned long size = end - dataBegin;
+		unsigned long size = getPosition();
+		unsigned char header[6];
+		unsigned long headerSize;
 
 		if (size < 0x3f && !IS_FLASH_LARGE_TAG_CODE(tagInfo.tag))
 		{
 			// Use short record header
-			unsigned short recordHeader = (tagInfo.tag << 6) | static_cast<unsigned short>(size);
-			setPosition(tagInfo.begin);
-			writeWord(recordHeader);
-			shiftContent(dataBegin, size, -4);
-			setPosition(end - 4);
+			storeWord(header, (tagInfo.tag << 6) | static_cast<unsigned short>(size));
+			headerSize = 2;
 		}
 		else
 		{
 			// Use long record header
-			setPosition(tagInfo.begin + 2);
-			writeLong(size);
-			setPosition(end);
+			storeWord(header, (tagInfo.tag << 6) | 0x3f);
+			storeLong(header + 2, size);
+			headerSize = 6;
+		}
+
+		unsigned int depth = getScratchDepth();
+		unsigned long base = endScratch(header, headerSize);
+		if (collectStats())
+		{
+			countTag(tagInfo.tag, headerSize + size);
+			getStatsRecord().headerFixups += 1;
+		}
+
+		// A sound stream head written inside this tag moves along with it
+		if (m_sndStreamFixupPos > 0 && m_sndStreamFixupDepth == depth)
+		{
+			m_sndStreamFixupPos += base;
+			--m_sndStreamFixupDepth;
 		}
 	}
 
-	// tagInfo.clear();
+	recordComplete();
+}
+
+// ----------------------------------------------------------------------------
+template <class Record>
+void SwfWriter::writeRecord(const Record& record)
+{
+	writeData(record.getData(), record.getSize());
+	if (collectStats())
+	{
+		countTag(record.getTag(), record.getSize());
+	}
+	recordComplete();
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::recordComplete()
+{
+	// In streaming mode, push completed top level tags out. A pending sound stream
+	// head still needs its fixup, so nothing from there on can leave the buffer yet.
+	if (isStreaming() && m_tagInfoList.empty() && getBufferedSize() >= STREAM_FLUSH_SIZE)
+	{
+		flushStream(m_sndStreamFixupPos > 0 ? m_sndStreamFixupPos : getPosition());
+	}
+
+	if (collectStats() && m_tagInfoList.empty())
+	{
+		WriterStats& stats = getStatsRecord();
+		stats.peakBufferSize = std::max<unsigned long long>(stats.peakBufferSize, getBufferedSize());
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::countTag(FlashTagCode tag, unsigned long recordSize)
+{
+	if (static_cast<unsigned int>(tag) < WriterStats::TAG_CODE_COUNT)
+	{
+		WriterStats::TagStats& stats = getStatsRecord().tags[tag];
+		stats.count += 1;
+		stats.bytes += recordSize;
+	}
 }
 
 // ----------------------------------------------------------------------------
@@ -201,93 +760,405 @@ void SwfWriter::writeNextCharacterID()
 	writeWord(++m_nextCharacterID);
 }
 
+// ----------------------------------------------------------------------------
+// State of one file of a batch define, filled in by loadAsset()
+struct SwfWriter::AssetLoad
+{
+	std::wstring filename;
+	AssetKey key;
+	CharacterID characterID;	// Content already defined
+	MappedFilePtr file;			// Content to define, if characterID is 0
+
+	explicit AssetLoad(FlashTagCode tag) : key(tag), characterID(0) {}
+};
+
+// ----------------------------------------------------------------------------
+static bool isJPEGData(const MappedFile& file)
+{
+	// SOI marker, optionally after the EOI+SOI pair older Flash tools prepended
+	const unsigned char* data = file.getData();
+	return (file.getSize() >= 2 && data[0] == 0xff && data[1] == 0xd8) ||
+		   (file.getSize() >= 4 && data[0] == 0xff && data[1] == 0xd9 && data[2] == 0xff && data[3] == 0xd8);
+}
+
+// ----------------------------------------------------------------------------
+static bool getJPEGSize(const MappedFile& file, unsigned int& width, unsigned int& height)
+{
+	// Walks the marker segments up to the first start of frame
+	const unsigned char* data = file.getData();
+	unsigned long size = file.getSize();
+	unsigned long pos = 0;
+	while (pos + 4 <= size)
+	{
+		if (data[pos] != 0xff)
+			return false;
+
+		unsigned char marker = data[pos + 1];
+		if (marker == 0xff)
+		{
+			++pos;		// Fill byte
+			continue;
+		}
+		if (marker == 0xd8 || marker == 0xd9 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+		{
+			pos += 2;	// No length
+			continue;
+		}
+		if (marker == 0xda)
+			return false;
+
+		unsigned long length = data[pos + 2] << 8 | data[pos + 3];
+		bool startOfFrame = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+		if (startOfFrame && length >= 7 && pos + 9 <= size)
+		{
+			height = data[pos + 5] << 8 | data[pos + 6];
+			width = data[pos + 7] << 8 | data[pos + 8];
+			return true;
+		}
+		pos += 2 + length;
+	}
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+static bool isSameContent(const MappedFile& a, const MappedFile& b)
+{
+	return a.getSize() == b.getSize() && memcmp(a.getData(), b.getData(), a.getSize()) == 0;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::findAsset(const std::wstring& filename, const MappedFile& file, AssetKey& key, CharacterID& characterID)
+{
+	// Leaves key ready to register the new character. A hash match is only
+	// taken once the bytes compare equal, a collision defines a new character.
+	if (!m_deduplicateAssets)
+		return false;
+
+	if (key.size != file.getSize())
+	{
+		key.hash = m_assetIndex->insert(filename, file);
+		key.size = file.getSize();
+	}
+
+	std::map<AssetKey, Asset>::const_iterator i = m_assets.find(key);
+	if (i == m_assets.end() || !isSameContent(*i->second.file, file))
+		return false;
+
+	characterID = i->second.characterID;
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::loadAsset(AssetLoad& load)
+{
+	// Runs on the thread pool, concurrently with other loads of the batch.
+	// Only reads m_assets, the caller updates it once all loads are done.
+	// The asset index spares hashing a file it already knows.
+	if (m_deduplicateAssets)
+	{
+		m_assetIndex->find(load.filename, load.key.hash, load.key.size);
+	}
+
+	MappedFilePtr file(new MappedFile);
+	if (!file->open(load.filename) || !isJPEGData(*file))
+		return;
+
+	bool hashed = m_deduplicateAssets && load.key.size != file->getSize();
+	if (findAsset(load.filename, *file, load.key, load.characterID))
+		return;
+
+	if (!hashed)
+	{
+		file->prefetch();
+	}
+	load.file = file;
+}
+
 // ----------------------------------------------------------------------------
 void SwfWriter::outputHeader()
 {
 	writeByte('F');
 	writeByte('W');
 	writeByte('S');
-	writeByte(6);	// SWF version 6+
-	writeLong(0);	// Place holder
+	writeByte(m_documentVersion);	// SWF version 6+
+	writeLong(m_progressive ? m_declaredFileLength : 0);	// Place holder unless progressive
 	writeRect(m_frameRect);
-	writeWord(m_frameRate * 256);	// or shift left 8 (<<8) for 8.8 notation
-	writeWord(m_frameCount);
+	writeWord(m_frameRate);	// 8.8 notation
+	writeWord(m_progressive ? m_declaredFrameCount : m_frameCount);
+	m_headerEnd = getPosition();
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::fixupHeader()
 {
-	// Skip FWS and version
-	setPosition(4);
+	// Skip FWS
+	if (collectStats())
+	{
+		getStatsRecord().headerFixups += 1;
+	}
+	setPosition(3);
+	writeByte(m_documentVersion);
 	writeLong(getFileSize());
 	writeRect(m_frameRect);
-	writeWord(m_frameRate * 256);	// or shift left 8 (<<8) for 8.8 notation
+	writeWord(m_frameRate);	// 8.8 notation
 	writeWord(m_frameCount);
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::outputEnd()
 {
-	writeRecordHeaderStart(SwfTag_End, 0);
-	writeRecordHeaderEnd();
+	writeRecord(FixedTagRecord<SwfTag_End, 0>());
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::outputSetBackground(const Color& color)
 {
-	writeRecordHeaderStart(SwfTag_SetBackgroundColor, 3);
-	writeColor(color);
-	writeRecordHeaderEnd();
+	FixedTagRecord<SwfTag_SetBackgroundColor, 3> record;
+	unsigned char* body = record.getBody();
+	body[0] = color.red;
+	body[1] = color.green;
+	body[2] = color.blue;
+	writeRecord(record);
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::outputShowFrame(bool onMainTimeline)
 {
-	writeRecordHeaderStart(SwfTag_ShowFrame, 0);
-	writeRecordHeaderEnd();
+	StatsTimer timer(collectStats() && m_progressive && onMainTimeline);
+	writeRecord(FixedTagRecord<SwfTag_ShowFrame, 0>());
 	if (onMainTimeline)
 	{
 		++m_frameCount;
+		if (m_progressive)
+		{
+			flushFrame(timer);
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::flushFrame(const StatsTimer& timer)
+{
+	// Hands every completed tag to the sink, through a zlib sync flush when
+	// compressing. A sound stream head still waiting for its first block
+	// holds back what follows it.
+	if (!m_tagInfoList.empty())
+		return;
+
+	flushStream(m_sndStreamFixupPos > 0 ? m_sndStreamFixupPos : getPosition());
+	if (m_documentCompressed && m_streamStarted)
+	{
+		StreamStatsTimer streamTimer(this);
+		m_stream.flush();
+	}
+	flushFileData();
+
+	if (timer.isActive())
+	{
+		double elapsed = timer.getElapsed();
+		WriterStats& stats = getStatsRecord();
+		stats.frameFlushes += 1;
+		stats.frameFlushTime += elapsed;
+		stats.maxFrameFlushTime = std::max(stats.maxFrameFlushTime, elapsed);
 	}
 }
 
 // ----------------------------------------------------------------------------
 SwfWriter::CharacterID SwfWriter::outputDefineBitsJPEG2(const std::wstring& jpegfile)
 {
-	CharacterID characterID = 0;
-	FILE* fp = _wfopen(jpegfile.c_str(), L"rb");
-	if (fp)
+	std::vector<std::wstring> jpegfiles(1, jpegfile);
+	std::vector<CharacterID> characterIDs;
+	outputDefineBitsJPEG2(jpegfiles, characterIDs);
+	return characterIDs[0];
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::outputDefineBitsJPEG2(const std::vector<std::wstring>& jpegfiles, std::vector<CharacterID>& characterIDs)
+{
+	// The files are opened, checked and read (or hashed) on the thread pool,
+	// then the tags are written in the order given, so the CharacterIDs do not
+	// depend on which file was ready first. Files that cannot be read or are
+	// not JPEG get 0. The tags reference the mapped files, the image data is
+	// only read again when the SWF is compressed or written out.
+	std::vector<AssetLoad> loads(jpegfiles.size(), AssetLoad(SwfTag_DefineBitsJPEG2));
+	TaskGroup group(m_threadPool);
+	for (unsigned int i = 0; i < jpegfiles.size(); ++i)
+	{
+		AssetLoad* load = &loads[i];
+		load->filename = jpegfiles[i];
+		group.run([this, load]() { loadAsset(*load); });
+	}
+	group.wait();
+
+	characterIDs.resize(jpegfiles.size());
+	for (unsigned int i = 0; i < loads.size(); ++i)
 	{
-		long fileSize = 0;
-		FileWriter::Buffer buffer;
-		if (fseek(fp, 0, SEEK_END) == 0)
+		AssetLoad& load = loads[i];
+		CharacterID characterID = load.characterID;
+		if (characterID == 0 && load.file)
 		{
-			fileSize = ftell(fp);
-			fseek(fp, 0, SEEK_SET);
+			// An earlier file of the batch may have had the same content
+			std::map<AssetKey, Asset>::const_iterator asset = m_assets.find(load.key);
+			if (m_deduplicateAssets && asset != m_assets.end() && isSameContent(*asset->second.file, *load.file))
+			{
+				characterID = asset->second.characterID;
+			}
+			else
+			{
+				MappedFilePtr& jpeg = load.file;
+				writeRecordHeaderStart(SwfTag_DefineBitsJPEG2, jpeg->getSize() + 2);
+				writeNextCharacterID();
+				writePayload(jpeg, jpeg->getData(), jpeg->getSize());
+				writeRecordHeaderEnd();
+				characterID = m_nextCharacterID;
+
+				// A colliding hash keeps the first character
+				if (m_deduplicateAssets && asset == m_assets.end())
+				{
+					Asset& defined = m_assets[load.key];
+					defined.characterID = characterID;
+					defined.file = jpeg;
+				}
+			}
 		}
+		characterIDs[i] = characterID;
+	}
+}
+
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::writeDefineBitsJPEG3(const std::wstring& jpegfile, const unsigned char* alpha, unsigned int width, unsigned int height,
+													   long stride, bool fromPixels)
+{
+	if (alpha == NULL || width == 0 || height == 0)
+		return 0;
 
-		if (fileSize > 0)
+	// The alpha plane is compressed on the thread pool while the JPEG is
+	// mapped and checked here. A plane with padded rows goes to the
+	// compressor as one span per row, pixels have their alpha extracted first.
+	std::shared_ptr<FileWriter::Buffer> alphaData(new FileWriter::Buffer());
+	TaskGroup group(m_threadPool);
+	group.run([=]()
+	{
+		DataSpanList spans;
+		if (fromPixels)
+		{
+			m_bitmapBuffer.resize(width * height);
+			extractAlpha(alpha, width, height, stride, &m_bitmapBuffer[0]);
+			spans.push_back(DataSpan(&m_bitmapBuffer[0], m_bitmapBuffer.size()));
+		}
+		else if (stride == static_cast<long>(width))
+		{
+			spans.push_back(DataSpan(alpha, width * height));
+		}
+		else
 		{
-			buffer.resize(fileSize);
-			fread(&buffer[0], 1, fileSize, fp);
-
-			writeRecordHeaderStart(SwfTag_DefineBitsJPEG2, fileSize + 2);
-			writeNextCharacterID();
-			writeData(buffer);
-			writeRecordHeaderEnd();
-			characterID = m_nextCharacterID;
+			spans.reserve(height);
+			for (unsigned int y = 0; y < height; ++y)
+			{
+				spans.push_back(DataSpan(alpha + static_cast<ptrdiff_t>(y) * stride, width));
+			}
 		}
+		m_bitmapCompressor.compress(spans, *alphaData);
+	});
 
-		fclose(fp);
+	// The alpha has to cover the JPEG exactly
+	MappedFilePtr jpeg(new MappedFile);
+	unsigned int jpegWidth = 0;
+	unsigned int jpegHeight = 0;
+	bool valid = jpeg->open(jpegfile) && isJPEGData(*jpeg) && getJPEGSize(*jpeg, jpegWidth, jpegHeight) &&
+				 jpegWidth == width && jpegHeight == height;
+	if (valid)
+	{
+		jpeg->prefetch();
+	}
+	group.wait();
+
+	if (!valid || alphaData->empty())
+		return 0;
+
+	writeRecordHeaderStart(SwfTag_DefineBitsJPEG3, jpeg->getSize() + alphaData->size() + 6);
+	writeNextCharacterID();
+	writeLong(jpeg->getSize());		// AlphaDataOffset
+	writePayload(jpeg, jpeg->getData(), jpeg->getSize());
+	writePayload(alphaData, &(*alphaData)[0], alphaData->size());
+	writeRecordHeaderEnd();
+	return m_nextCharacterID;
+}
+
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::outputDefineBitsJPEG3(const std::wstring& jpegfile, const unsigned char* alpha,
+														 unsigned int width, unsigned int height, long stride)
+{
+	// 8-bit alpha plane, rows stride bytes apart
+	return writeDefineBitsJPEG3(jpegfile, alpha, width, height, stride, false);
+}
+
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::outputDefineBitsJPEG3FromPixels(const std::wstring& jpegfile, const unsigned char* pixels,
+																   unsigned int width, unsigned int height, long stride)
+{
+	// 32-bit RGBA or BGRA rows, only the alpha byte is used
+	return writeDefineBitsJPEG3(jpegfile, pixels, width, height, stride, true);
+}
+
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::writeDefineBitsLossless(FlashTagCode tag, const unsigned char* pixels, unsigned int width, unsigned int height,
+														   long stride, PixelFormat format, AlphaMode alpha)
+{
+	if (pixels == NULL || width == 0 || height == 0 || width > 0xffff || height > 0xffff)
+		return 0;
+
+	// Converted in bands of rows on the thread pool, the compressor then
+	// deflates large bitmaps in parallel blocks as well
+	const unsigned int bandHeight = 64;
+	unsigned long rowSize = width * 4;
+	m_bitmapBuffer.resize(rowSize * height);
+	unsigned char* argb = &m_bitmapBuffer[0];
+	TaskGroup group(height > bandHeight ? m_threadPool : NULL);
+	for (unsigned int y = 0; y < height; y += bandHeight)
+	{
+		unsigned int rows = std::min(bandHeight, height - y);
+		const unsigned char* src = pixels + static_cast<ptrdiff_t>(y) * stride;
+		unsigned char* dst = argb + y * rowSize;
+		group.run([=]() { convertToARGB(src, width, rows, stride, format, alpha, dst); });
 	}
+	group.wait();
+
+	// Referenced by the tag rather than copied into the body
+	std::shared_ptr<FileWriter::Buffer> bitmapData(new FileWriter::Buffer());
+	if (m_bitmapCompressor.compress(argb, m_bitmapBuffer.size(), *bitmapData) == 0)
+		return 0;
+
+	writeRecordHeaderStart(tag, bitmapData->size() + 7);
+	writeNextCharacterID();
+	writeByte(5);					// BitmapFormat - 32-bit pixels
+	writeWord(width);
+	writeWord(height);
+	writePayload(bitmapData, &(*bitmapData)[0], bitmapData->size());
+	writeRecordHeaderEnd();
+	return m_nextCharacterID;
+}
+
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::outputDefineBitsLossless(const unsigned char* pixels, unsigned int width, unsigned int height,
+															long stride, PixelFormat format)
+{
+	// Opaque PIX24 pixels, the source alpha is dropped
+	return writeDefineBitsLossless(SwfTag_DefineBitsLossless, pixels, width, height, stride, format, Alpha_Opaque);
+}
 
-	return characterID;
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::outputDefineBitsLossless2(const unsigned char* pixels, unsigned int width, unsigned int height,
+															 long stride, PixelFormat format, bool premultiplied)
+{
+	return writeDefineBitsLossless(SwfTag_DefineBitsLossless2, pixels, width, height, stride, format,
+								   premultiplied ? Alpha_Premultiplied : Alpha_Premultiply);
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::writeVertHorzEdge(bool isVertical, int delta)
 {
-	unsigned int numBits = countRequiredBits(std::abs(delta)) + 1; // include sign bit
+	unsigned int numBits = BitWriter::countRequiredBits(std::abs(delta)) + 1; // include sign bit
 	writeBits(1, 1);	// edge record
 	writeBits(1, 1);	// straight edge
 	writeBits(numBits-2, 4);
@@ -314,7 +1185,7 @@ SwfWriter::CharacterID SwfWriter::outputDefineBitmapShape(CharacterID bitmapID,
 	// Output scale matrix of 20/20
 	initWriteBits();
 	int scaleValue = 20 << 16;	// convert to fixed 16.16
-	unsigned int numBits = countRequiredBits(scaleValue) + 1;	// include the sign bit
+	unsigned int numBits = BitWriter::countRequiredBits(scaleValue) + 1;	// include the sign bit
 	writeBits(1, 1);	// has scale
 	writeBits(numBits, 5);
 	writeBits(scaleValue, numBits);
@@ -377,11 +1248,12 @@ void SwfWriter::outputDefineSpriteEnd()
 // ----------------------------------------------------------------------------
 void SwfWriter::outputPlaceObject2(CharacterID id, unsigned int depth)
 {
-	writeRecordHeaderStart(SwfTag_PlaceObject2, 5);
-	writeByte(0x02);	// has character ID
-	writeWord(depth);
-	writeWord(id);
-	writeRecordHeaderEnd();
+	FixedTagRecord<SwfTag_PlaceObject2, 5> record;
+	unsigned char* body = record.getBody();
+	body[0] = 0x02;		// has character ID
+	storeWord(body + 1, depth);
+	storeWord(body + 3, id);
+	writeRecord(record);
 }
 
 // ----------------------------------------------------------------------------
@@ -395,12 +1267,24 @@ void SwfWriter::outputPlaceObject2(CharacterID id, unsigned int depth, const std
 	writeRecordHeaderEnd();
 }
 
+// ----------------------------------------------------------------------------
+void SwfWriter::outputPlaceObject2Ratio(unsigned int depth, unsigned int ratio)
+{
+	// Moves the object at depth, a video stream shows the frame given by ratio
+	FixedTagRecord<SwfTag_PlaceObject2, 5> record;
+	unsigned char* body = record.getBody();
+	body[0] = 0x11;		// move & has ratio
+	storeWord(body + 1, depth);
+	storeWord(body + 3, ratio);
+	writeRecord(record);
+}
+
 // ----------------------------------------------------------------------------
 void SwfWriter::outputRemoveObject2(unsigned int depth)
 {
-	writeRecordHeaderStart(SwfTag_RemoveObject2, 2);
-	writeWord(depth);
-	writeRecordHeaderEnd();
+	FixedTagRecord<SwfTag_RemoveObject2, 2> record;
+	storeWord(record.getBody(), depth);
+	writeRecord(record);
 }
 
 // ----------------------------------------------------------------------------
@@ -413,6 +1297,34 @@ void SwfWriter::outputExportAssets(CharacterID id, const std::wstring& name)
 	writeRecordHeaderEnd();
 }
 
+// ----------------------------------------------------------------------------
+SwfWriter::CharacterID SwfWriter::outputDefineVideoStream(unsigned int frameCount, unsigned int width, unsigned int height, VideoCodec codec)
+{
+	// Screen Video needs SWF 7
+	requireVersion(7);
+
+	FixedTagRecord<SwfTag_DefineVideoStream, 10> record;
+	unsigned char* body = record.getBody();
+	storeWord(body, ++m_nextCharacterID);
+	storeWord(body + 2, frameCount);
+	storeWord(body + 4, width);
+	storeWord(body + 6, height);
+	body[8] = 0;		// no deblocking or smoothing
+	body[9] = static_cast<unsigned char>(codec);
+	writeRecord(record);
+	return m_nextCharacterID;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::outputVideoFrame(CharacterID streamID, unsigned int frameNumber, const Buffer& packet)
+{
+	writeRecordHeaderStart(SwfTag_VideoFrame, packet.size() + 4);
+	writeWord(streamID);
+	writeWord(frameNumber);
+	writePayload(packet);
+	writeRecordHeaderEnd();
+}
+
 // ----------------------------------------------------------------------------
 void SwfWriter::outputSoundStreamBegin(SamplingRate playbackRate, 
 									   SoundType playbackType, 
@@ -420,7 +1332,9 @@ void SwfWriter::outputSoundStreamBegin(SamplingRate playbackRate,
 									   SamplingRate streamRate, 
 									   SoundType streamType)
 {
-	writeRecordHeaderStart(SwfTag_SoundStreamHead, 6);
+	// The latency seek is only there for MP3
+	m_sndStreamFixupSize = (compressionType == SwfMP3) ? 4 : 2;
+	writeRecordHeaderStart(SwfTag_SoundStreamHead, 2 + m_sndStreamFixupSize);
 	
 	initWriteBits();
 	writeBits(0, 4);				// Reserved - always zeros
@@ -435,6 +1349,7 @@ void SwfWriter::outputSoundStreamBegin(SamplingRate playbackRate,
 
 	// These fields are initialized to zero, will be fixed up later...
 	m_sndStreamFixupPos = getPosition();
+	m_sndStreamFixupDepth = getScratchDepth();
 	writeWord(0);					// Average # of samples in each SoundStreamBlock
 	if (compressionType == SwfMP3)
 	{								// Latency seek should match SeekSamples field in
@@ -446,35 +1361,139 @@ void SwfWriter::outputSoundStreamBegin(SamplingRate playbackRate,
 // ----------------------------------------------------------------------------
 void SwfWriter::ouputMP3StreamEnd(unsigned short sampleCount, short latencySeek)
 {
+	// Also resolves an ADPCM head, which only has the sample count
 	if (m_sndStreamFixupPos > 0)
 	{
-		unsigned long currPos = getPosition();
-		setPosition(m_sndStreamFixupPos);
-
-		writeWord(sampleCount);		// Average # of samples in each SoundStreamBlock
-		writeWord(latencySeek);		// Latency seek should match SeekSamples field in
-									// the first SoundStream block for this stream.
+		unsigned char fixup[4];
+		storeWord(fixup, sampleCount);		// Average # of samples in each SoundStreamBlock
+		storeWord(fixup + 2, latencySeek);	// Latency seek should match SeekSamples field in
+											// the first SoundStream block for this stream.
+		patchData(m_sndStreamFixupDepth, m_sndStreamFixupPos, fixup, m_sndStreamFixupSize);
+		if (collectStats())
+		{
+			getStatsRecord().headerFixups += 1;
+		}
 		m_sndStreamFixupPos = 0;
-		setPosition(currPos);
+		m_sndStreamFixupDepth = 0;
 	}
 }
 
 // ----------------------------------------------------------------------------
 void SwfWriter::outputMP3StreamBlock(unsigned short sampleCount, unsigned short seekSamples, const Buffer& data)
 {
+	// Progressive output cannot wait for the end of the stream, the head takes
+	// its values from the first block
+	if (m_progressive && m_sndStreamFixupPos > 0)
+	{
+		ouputMP3StreamEnd(sampleCount, seekSamples);
+	}
+
 	unsigned int dataSize = data.size();
 	writeRecordHeaderStart(SwfTag_SoundStreamBlock, dataSize + 4);
 	writeWord(sampleCount);
 	writeWord(seekSamples);
-	writeData(data);
+	writePayload(data);
 	writeRecordHeaderEnd();
 }
 
 // ----------------------------------------------------------------------------
-void SwfWriter::outputDoActionStop()
+bool SwfWriter::outputMP3StreamBegin(const MP3Stream& stream)
 {
-	writeRecordHeaderStart(SwfTag_DoAction, 2);
-	writeByte(SwfAction_Stop);
-	writeByte(0);
+	SamplingRate rate;
+	switch (stream.getSampleRate())
+	{
+	case 11025:	rate = SwfSampleRate_11KHz;	break;
+	case 22050:	rate = SwfSampleRate_22KHz;	break;
+	case 44100:	rate = SwfSampleRate_44KHz;	break;
+	default:	return false;
+	}
+
+	// The whole file was scanned on open, so the head gets its final values
+	// right away and nothing is held back while streaming
+	SoundType type = stream.getChannels() == 2 ? SwfSndStereo : SwfSndMono;
+	unsigned int frameRate = std::max<unsigned int>(1, m_frameRate);
+	outputSoundStreamBegin(rate, type, SwfMP3, rate, type);
+	ouputMP3StreamEnd(static_cast<unsigned short>((stream.getSampleRate() * 256 + frameRate / 2) / frameRate), 0);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::outputMP3StreamBlock(MP3Stream& stream)
+{
+	// One block per SWF frame, a frame already covered by the previous block
+	// simply gets none
+	MP3Stream::Block block;
+	if (!stream.nextBlock(std::max<unsigned int>(1, m_frameRate), block))
+		return false;
+
+	if (block.runs.empty())
+		return true;
+
+	writeRecordHeaderStart(SwfTag_SoundStreamBlock, block.size + 4);
+	writeWord(block.sampleCount);
+	writeWord(block.seekSamples);
+	for (DataSpanList::const_iterator i = block.runs.begin(); i != block.runs.end(); ++i)
+	{
+		// Short runs are cheaper to copy than to store as their own span
+		if (i->size >= MIN_STORED_RANGE_SIZE)
+		{
+			writePayload(stream.getFile(), i->data, i->size);
+		}
+		else
+		{
+			writeData(i->data, i->size);
+		}
+	}
 	writeRecordHeaderEnd();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::outputADPCMStreamBegin(ADPCMStream& stream)
+{
+	SamplingRate rate;
+	switch (stream.getSampleRate())
+	{
+	case 5512:
+	case 5513:	rate = SwfSampleRate_5_5KHz;	break;
+	case 11025:	rate = SwfSampleRate_11KHz;		break;
+	case 22050:	rate = SwfSampleRate_22KHz;		break;
+	case 44100:	rate = SwfSampleRate_44KHz;		break;
+	default:	return false;
+	}
+
+	// Every block is encoded up front on the thread pool, the head gets its
+	// final values right away as for MP3Stream
+	unsigned int frameRate = std::max<unsigned int>(1, m_frameRate);
+	if (!stream.encode(frameRate, m_threadPool))
+		return false;
+
+	SoundType type = stream.getChannels() == 2 ? SwfSndStereo : SwfSndMono;
+	outputSoundStreamBegin(rate, type, SwfADPCM, rate, type);
+	ouputMP3StreamEnd(static_cast<unsigned short>((stream.getSampleRate() * 256 + frameRate / 2) / frameRate), 0);
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+bool SwfWriter::outputADPCMStreamBlock(ADPCMStream& stream)
+{
+	// One block per SWF frame, false once the stream is exhausted
+	const BitWriter* block = stream.nextBlock();
+	if (block == NULL)
+		return false;
+
+	writeRecordHeaderStart(SwfTag_SoundStreamBlock, block->getSize());
+	writeData(block->getData(), block->getSize());
+	writeRecordHeaderEnd();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void SwfWriter::outputDoActionStop()
+{
+	FixedTagRecord<SwfTag_DoAction, 2> record;
+	unsigned char* body = record.getBody();
+	body[0] = SwfAction_Stop;
+	body[1] = 0;	// end of actions
+	writeRecord(record);
 }
@@ -1,7 +1,17 @@
+#pragma once
+
 #include "FileWriter.h"
+#include <map>
+#include "Compress.h"
+#include "AssetIndex.h"
+#include "PixelConvert.h"
+
+class MappedFile;
+class MP3Stream;
+class ADPCMStream;
 
 // ----------------------------------------------------------------------------
-class SwfWriter : public FileWriter
+class SwfWriter : public FileWriter, private ZLIBStream::Output
 {
 public:
 	// ------------------------------------------------------------------------
@@ -11,18 +21,37 @@ public:
 		SwfTag_ShowFrame			= 1,
 		SwfTag_DefineShape			= 2,
 		SwfTag_DefineBits			= 6,
+		SwfTag_DefineButton			= 7,
 		SwfTag_SetBackgroundColor	= 9,
+		SwfTag_DefineFont			= 10,
+		SwfTag_DefineText			= 11,
 		SwfTag_DoAction				= 12,
+		SwfTag_DefineSound			= 14,
 		SwfTag_SoundStreamHead		= 18,
 		SwfTag_SoundStreamBlock		= 19,
 		SwfTag_DefineBitsLossless	= 20,
 		SwfTag_DefineBitsJPEG2		= 21,
+		SwfTag_DefineShape2			= 22,
 		SwfTag_PlaceObject2			= 26,
 		SwfTag_RemoveObject2		= 28,
+		SwfTag_DefineShape3			= 32,
+		SwfTag_DefineText2			= 33,
+		SwfTag_DefineButton2		= 34,
 		SwfTag_DefineBitsJPEG3		= 35,
 		SwfTag_DefineBitsLossless2	= 36,
+		SwfTag_DefineEditText		= 37,
 		SwfTag_DefineSprite			= 39,
-		SwfTag_DefineExportAssets	= 56
+		SwfTag_DefineMorphShape		= 46,
+		SwfTag_DefineFont2			= 48,
+		SwfTag_DefineExportAssets	= 56,
+		SwfTag_DefineVideoStream	= 60,
+		SwfTag_VideoFrame			= 61,
+		SwfTag_DefineFont3			= 75,
+		SwfTag_DefineShape4			= 83,
+		SwfTag_DefineMorphShape2	= 84,
+		SwfTag_DefineBinaryData		= 87,
+		SwfTag_DefineBitsJPEG4		= 90,
+		SwfTag_DefineFont4			= 91
 	};
 
 	// ------------------------------------------------------------------------
@@ -54,30 +83,52 @@ public:
 		SwfMP3						= 2
 	};
 
+	// ------------------------------------------------------------------------
+	enum VideoCodec
+	{
+		SwfScreenVideo				= 3
+	};
+
 private:
 	// ------------------------------------------------------------------------
 	struct TagInfo
 	{
-		bool requireFixup;
+		bool scratch;		// Unsized tag, its body goes to a scratch buffer
 		FlashTagCode tag;
-		unsigned long begin;
 
-		TagInfo() : requireFixup(false), tag(SwfTag_End), begin(0) {}
-		TagInfo(bool _requireFixup, FlashTagCode _tag, unsigned long _begin) :
-			requireFixup(_requireFixup),
-			tag(_tag),
-			begin(_begin)
+		TagInfo() : scratch(false), tag(SwfTag_End) {}
+		TagInfo(bool _scratch, FlashTagCode _tag) :
+			scratch(_scratch),
+			tag(_tag)
 		{
 		}
-		void clear()
-		{ 
-			requireFixup = false;
-			begin = 0;
-			tag = SwfTag_End;
-		}
 	};
 	typedef std::vector<TagInfo> TagInfoList;
 
+	// ------------------------------------------------------------------------
+	struct AssetLoad;
+	class StreamStatsTimer;
+
+	// ------------------------------------------------------------------------
+	// Identifies the content of a character defined from an asset file
+	struct AssetKey
+	{
+		FlashTagCode tag;
+		unsigned long size;
+		unsigned long long hash;
+
+		AssetKey() : tag(SwfTag_End), size(0), hash(0) {}
+		explicit AssetKey(FlashTagCode _tag) : tag(_tag), size(0), hash(0) {}
+		bool operator<(const AssetKey& other) const
+		{
+			if (hash != other.hash)
+				return hash < other.hash;
+			if (size != other.size)
+				return size < other.size;
+			return tag < other.tag;
+		}
+	};
+
 public:
 	// ------------------------------------------------------------------------
 	typedef unsigned short CharacterID;
@@ -123,38 +174,104 @@ public:
 	};
 
 private:
+	// ------------------------------------------------------------------------
+	// A defined asset, its file stays mapped so a matching hash can be checked
+	// against the content. The document references the file anyway.
+	struct Asset
+	{
+		CharacterID characterID;
+		std::shared_ptr<MappedFile> file;
+	};
+
 	// ------------------------------------------------------------------------
 	TagInfoList m_tagInfoList;
 	bool m_compressSwf;
+	bool m_documentCompressed;			// m_compressSwf, or the format of an appended file
+	Compressor::Tier m_compressionTier;
+	Compressor* m_compressor;
+	ZLIBCompressor m_zlibCompressor;
+	ZLIBCompressor m_bitmapCompressor;		// Bitmap data, the body compressor may be busy on the writer thread
+	FileWriter::Buffer m_bitmapBuffer;
+	ThreadPool* m_threadPool;
+	AssetIndex* m_assetIndex;
+	AssetIndex m_localAssetIndex;
+	bool m_deduplicateAssets;
+	std::map<AssetKey, Asset> m_assets;
+	FileWriter::Buffer m_compressedBuffer;
+	bool m_reuse;
+	std::atomic<unsigned long> m_bufferAllocationCount;
 	CharacterID m_nextCharacterID;
-	unsigned short m_frameRate;
+	unsigned char m_version;
+	unsigned char m_documentVersion;	// m_version, or more if a tag needs it
+	unsigned short m_frameRate;			// 8.8 fixed point, as in the header
 	unsigned short m_frameCount;
 	Rect m_frameRect;
 	unsigned long m_sndStreamFixupPos;
+	unsigned int m_sndStreamFixupDepth;
+	unsigned int m_sndStreamFixupSize;		// The latency seek is only there for MP3
+	unsigned long m_headerEnd;
+
+	// Streaming output state
+	ZLIBStream m_stream;
+	bool m_streamStarted;
+	bool m_progressive;
+	unsigned short m_declaredFrameCount;
+	unsigned long m_declaredFileLength;
 
 protected:
 	// ------------------------------------------------------------------------
 	void writeRecordHeaderStart(FlashTagCode tag);
 	void writeRecordHeaderStart(FlashTagCode tag, unsigned long size);
 	void writeRecordHeaderEnd();
+	template <class Record> void writeRecord(const Record& record);
+	void recordComplete();
+	void flushFrame(const StatsTimer& timer);
+	void countTag(FlashTagCode tag, unsigned long recordSize);
 	void writeNextCharacterID();
+	void requireVersion(unsigned char version);
 	void writeColor(const Color& color);
 	void writeRect(const Rect& rect);
 	void writeVertHorzEdge(bool isVertical, int delta);
 	void fixupHeader();
+	void resetDocument();
+	void releaseCompressionState();
+	bool findAsset(const std::wstring& filename, const MappedFile& file, AssetKey& key, CharacterID& characterID);
+	void loadAsset(AssetLoad& load);
+	CharacterID writeDefineBitsLossless(FlashTagCode tag, const unsigned char* pixels, unsigned int width, unsigned int height,
+										long stride, PixelFormat format, AlphaMode alpha);
+	CharacterID writeDefineBitsJPEG3(const std::wstring& jpegfile, const unsigned char* alpha, unsigned int width, unsigned int height,
+									 long stride, bool fromPixels);
 
 protected:
 	// ------------------------------------------------------------------------
-	virtual void writeBuffer();
+	virtual bool writeBuffer(ClosedFile& file);
+	virtual void writeStreamData(unsigned long pos, const DataSpanList& spans);
+	virtual void finishStream();
+	virtual void writeCompressed(const unsigned char* data, unsigned int size);
 
 public:
 	// ------------------------------------------------------------------------
 	SwfWriter();
 	virtual ~SwfWriter();
 
-	virtual void close();
+	virtual bool close();
+	virtual CloseResult closeAsync();
+	bool openAppend(const std::wstring& filename);
 
 	void setCompression(bool compress);
+	void setCompressionTier(Compressor::Tier tier);
+	void setCompressor(Compressor* compressor);
+	void setThreadPool(ThreadPool* pool);
+	void setReuse(bool reuse);
+	void setProgressive(bool progressive, unsigned short frameCount = 0, unsigned long fileLength = 0);
+	inline bool isProgressive() const { return m_progressive; }
+	unsigned long getAllocationCount() const;
+	static const char* getTagName(unsigned int code);
+	std::string getStatsJSON();
+	void setDeduplicateAssets(bool deduplicate);
+	void setAssetIndex(AssetIndex* index);
+	void setVersion(unsigned char version);
+	inline unsigned char getVersion() const { return m_documentVersion; }
 	void setFrameRate(unsigned int fps);
 	void setFrameRect(int xmin, int xmax, int ymin, int ymax);
 	inline const Rect& getFrameRect() const { return m_frameRect; }
@@ -162,6 +279,12 @@ public:
 	void outputHeader();
 	void outputSetBackground(const Color& color);
 	CharacterID outputDefineBitsJPEG2(const std::wstring& jpegfile);
+	void outputDefineBitsJPEG2(const std::vector<std::wstring>& jpegfiles, std::vector<CharacterID>& characterIDs);
+	CharacterID outputDefineBitsJPEG3(const std::wstring& jpegfile, const unsigned char* alpha, unsigned int width, unsigned int height, long stride);
+	CharacterID outputDefineBitsJPEG3FromPixels(const std::wstring& jpegfile, const unsigned char* pixels, unsigned int width, unsigned int height, long stride);
+	CharacterID outputDefineBitsLossless(const unsigned char* pixels, unsigned int width, unsigned int height, long stride, PixelFormat format);
+	CharacterID outputDefineBitsLossless2(const unsigned char* pixels, unsigned int width, unsigned int height, long stride,
+										  PixelFormat format, bool premultiplied = false);
 	CharacterID outputDefineBitmapShape(CharacterID bitmapID, const Rect& bounds);
 	void outputExportAssets(CharacterID id, const std::wstring& name);
 	void outputShowFrame(bool onMainTimeline);
@@ -171,8 +294,13 @@ public:
 	void outputDefineSpriteEnd();
 	void outputPlaceObject2(CharacterID id, unsigned int depth);
 	void outputPlaceObject2(CharacterID id, unsigned int depth, const std::wstring& name);
+	void outputPlaceObject2Ratio(unsigned int depth, unsigned int ratio);
 	void outputRemoveObject2(unsigned int depth);
 
+	CharacterID outputDefineVideoStream(unsigned int frameCount, unsigned int width, unsigned int height,
+										VideoCodec codec = SwfScreenVideo);
+	void outputVideoFrame(CharacterID streamID, unsigned int frameNumber, const Buffer& packet);
+
 	void outputSoundStreamBegin(SamplingRate playbackRate, 
 								SoundType playbackType, 
 								SoundCompression compressionType, 
@@ -180,6 +308,10 @@ public:
 								SoundType streamType);
 	void ouputMP3StreamEnd(unsigned short sampleCount, short latencySeek);
 	void outputMP3StreamBlock(unsigned short sampleCount, unsigned short seekSamples, const Buffer& data);
+	bool outputMP3StreamBegin(const MP3Stream& stream);
+	bool outputMP3StreamBlock(MP3Stream& stream);
+	bool outputADPCMStreamBegin(ADPCMStream& stream);
+	bool outputADPCMStreamBlock(ADPCMStream& stream);
 
 	void outputDoActionStop();
 };
\ No newline at end of file
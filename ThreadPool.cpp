@@ -0,0 +1,233 @@
+#include <algorithm>
+#include "ThreadPool.h"
+
+// ----------------------------------------------------------------------------
+// Pool and index of the worker running on the current thread
+static thread_local const ThreadPool* t_pool = NULL;
+static thread_local int t_workerIndex = -1;
+
+// ----------------------------------------------------------------------------
+ThreadPool::ThreadPool(unsigned int threadCount) :
+	m_queued(0),
+	m_stopping(false)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	m_workers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+
+	m_threads.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+}
+
+// ----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+
+	for (std::vector<std::thread>::iterator i = m_threads.begin(); i != m_threads.end(); ++i)
+	{
+		i->join();
+	}
+}
+
+// ----------------------------------------------------------------------------
+int ThreadPool::getWorkerIndex() const
+{
+	return t_pool == this ? t_workerIndex : -1;
+}
+
+// ----------------------------------------------------------------------------
+void ThreadPool::submit(const Task& task)
+{
+	int index = getWorkerIndex();
+	if (index >= 0)
+	{
+		Worker& worker = *m_workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(task);
+	}
+
+	// Counted under m_mutex after the push, so a worker about to sleep sees it
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (index < 0)
+		{
+			m_tasks.push_back(task);
+		}
+		++m_queued;
+	}
+	m_condition.notify_one();
+}
+
+// ----------------------------------------------------------------------------
+bool ThreadPool::takeTask(int index, bool external, Task& task)
+{
+	// Own queue newest first, then the external queue, then steal the oldest
+	// task of another worker
+	if (index >= 0)
+	{
+		Worker& worker = *m_workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.tasks.empty())
+		{
+			task.swap(worker.tasks.back());
+			worker.tasks.pop_back();
+			--m_queued;
+			return true;
+		}
+	}
+
+	if (external)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_tasks.empty())
+		{
+			task.swap(m_tasks.front());
+			m_tasks.pop_front();
+			--m_queued;
+			return true;
+		}
+	}
+
+	unsigned int count = m_workers.size();
+	unsigned int start = index >= 0 ? index + 1 : 0;
+	for (unsigned int n = 0; n < count; ++n)
+	{
+		unsigned int victim = (start + n) % count;
+		if (static_cast<int>(victim) == index)
+			continue;
+
+		Worker& worker = *m_workers[victim];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.tasks.empty())
+		{
+			task.swap(worker.tasks.front());
+			worker.tasks.pop_front();
+			--m_queued;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// ----------------------------------------------------------------------------
+bool ThreadPool::runPendingTask()
+{
+	// A worker helping out while it waits does not start new external work,
+	// that would only delay what it is waiting for
+	int index = getWorkerIndex();
+	Task task;
+	if (!takeTask(index, index < 0, task))
+		return false;
+
+	task();
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+void ThreadPool::workerLoop(unsigned int index)
+{
+	t_pool = this;
+	t_workerIndex = index;
+
+	for (;;)
+	{
+		Task task;
+		if (takeTask(index, true, task))
+		{
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!m_stopping && m_queued <= 0)
+		{
+			m_condition.wait(lock);
+		}
+
+		// Drain the queues before stopping so no submitted task is lost
+		if (m_stopping && m_queued <= 0)
+			return;
+	}
+}
+
+// ----------------------------------------------------------------------------
+TaskGroup::TaskGroup(ThreadPool* pool) :
+	m_pool(pool),
+	m_pending(0)
+{
+}
+
+// ----------------------------------------------------------------------------
+TaskGroup::~TaskGroup()
+{
+	wait();
+}
+
+// ----------------------------------------------------------------------------
+void TaskGroup::run(const ThreadPool::Task& task)
+{
+	if (m_pool == NULL)
+	{
+		task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_pending;
+	}
+
+	m_pool->submit([this, task]()
+	{
+		task();
+		taskDone();
+	});
+}
+
+// ----------------------------------------------------------------------------
+void TaskGroup::taskDone()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (--m_pending == 0)
+	{
+		m_condition.notify_all();
+	}
+}
+
+// ----------------------------------------------------------------------------
+void TaskGroup::wait()
+{
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_pending == 0)
+				return;
+		}
+
+		// Help out instead of blocking while there is queued work
+		if (m_pool == NULL || !m_pool->runPendingTask())
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_pending == 0)
+				return;
+			m_condition.wait(lock);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+// Fixed set of worker threads with work stealing. Tasks submitted from outside
+// the pool are queued in submission order. Tasks a worker submits go to its own
+// queue, which it works through newest first while idle workers steal the
+// oldest ones.
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct Worker
+	{
+		std::deque<Task> tasks;
+		std::mutex mutex;
+	};
+
+private:
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<Worker> > m_workers;
+	std::deque<Task> m_tasks;				// Submitted from outside the pool
+	std::atomic<int> m_queued;				// Tasks in all queues, may lag behind briefly
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping;
+
+private:
+	void workerLoop(unsigned int index);
+	bool takeTask(int index, bool external, Task& task);
+
+public:
+	explicit ThreadPool(unsigned int threadCount = 0);	// 0 => one per hardware thread
+	~ThreadPool();
+
+	inline unsigned int getThreadCount() const { return m_threads.size(); }
+	int getWorkerIndex() const;		// -1 when not called from a worker of this pool
+
+	void submit(const Task& task);
+	bool runPendingTask();
+};
+
+// ----------------------------------------------------------------------------
+// Tracks a set of tasks submitted to a pool so the caller can wait for them.
+// Waiting threads execute queued tasks themselves, so groups may be waited on
+// from inside a pool task without starving the pool.
+class TaskGroup
+{
+private:
+	ThreadPool* m_pool;
+	unsigned int m_pending;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+
+private:
+	TaskGroup(const TaskGroup&);
+	TaskGroup& operator=(const TaskGroup&);
+
+	void taskDone();
+
+public:
+	explicit TaskGroup(ThreadPool* pool);
+	~TaskGroup();
+
+	void run(const ThreadPool::Task& task);
+	void wait();
+};
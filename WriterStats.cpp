@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include "WriterStats.h"
+
+// ----------------------------------------------------------------------------
+void WriterStats::clear()
+{
+	documentCount = 0;
+	emitTime = 0;
+	compressTime = 0;
+	ioTime = 0;
+	headerFixups = 0;
+	movedBytes = 0;
+	peakBufferSize = 0;
+	documentBytes = 0;
+	outputBytes = 0;
+	frameFlushes = 0;
+	frameFlushTime = 0;
+	maxFrameFlushTime = 0;
+	memset(tags, 0, sizeof(tags));
+}
+
+// ----------------------------------------------------------------------------
+double WriterStats::getCompressionRatio() const
+{
+	return documentBytes > 0 ? static_cast<double>(outputBytes) / documentBytes : 0;
+}
+
+// ----------------------------------------------------------------------------
+std::string WriterStats::toJSON(TagNameFunction tagName) const
+{
+	char line[256];
+	std::string json("{\n");
+
+	snprintf(line, sizeof(line), "\t\"documents\": %llu,\n", documentCount);
+	json += line;
+	snprintf(line, sizeof(line), "\t\"time\": { \"emit\": %.6f, \"compress\": %.6f, \"io\": %.6f },\n", emitTime, compressTime, ioTime);
+	json += line;
+	snprintf(line, sizeof(line), "\t\"header_fixups\": %llu,\n\t\"moved_bytes\": %llu,\n\t\"peak_buffer_size\": %llu,\n",
+			 headerFixups, movedBytes, peakBufferSize);
+	json += line;
+	snprintf(line, sizeof(line), "\t\"document_bytes\": %llu,\n\t\"output_bytes\": %llu,\n\t\"compression_ratio\": %.6f,\n",
+			 documentBytes, outputBytes, getCompressionRatio());
+	json += line;
+	snprintf(line, sizeof(line), "\t\"frame_flush\": { \"count\": %llu, \"time\": %.6f, \"max_time\": %.6f },\n",
+			 frameFlushes, frameFlushTime, maxFrameFlushTime);
+	json += line;
+
+	json += "\t\"tags\": [";
+	bool first = true;
+	for (unsigned int code = 0; code < TAG_CODE_COUNT; ++code)
+	{
+		if (tags[code].count == 0)
+			continue;
+
+		const char* name = tagName ? tagName(code) : NULL;
+		snprintf(line, sizeof(line), "%s\n\t\t{ \"code\": %u, \"name\": \"%s\", \"count\": %llu, \"bytes\": %llu }",
+				 first ? "" : ",", code, name ? name : "", tags[code].count, tags[code].bytes);
+		json += line;
+		first = false;
+	}
+	json += "\n\t]\n}\n";
+
+	return json;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+
+// ----------------------------------------------------------------------------
+// What a writer did since its stats were last reset. Only collected when the
+// library is built with SWF_ENABLE_STATS and the writer has them switched on,
+// otherwise everything stays 0 and the checks compile away.
+struct WriterStats
+{
+	enum { TAG_CODE_COUNT = 128 };	// Codes beyond are not counted per tag
+
+	struct TagStats
+	{
+		unsigned long long count;
+		unsigned long long bytes;	// Whole records, a sprite includes its nested tags
+	};
+
+	typedef const char* (*TagNameFunction)(unsigned int code);
+
+	unsigned long long documentCount;
+	double emitTime;					// Seconds building documents, streamed output excluded
+	double compressTime;				// Seconds in the compressor
+	double ioTime;						// Seconds writing files
+	unsigned long long headerFixups;	// Sizes and counts written after the content they describe
+	unsigned long long movedBytes;		// Copied to put a record body behind its header
+	unsigned long long peakBufferSize;	// Largest document held in memory at a tag boundary
+	unsigned long long documentBytes;	// Uncompressed size of the documents
+	unsigned long long outputBytes;		// Written to disk
+	unsigned long long frameFlushes;	// Progressive mode, from ShowFrame to bytes handed to the sink
+	double frameFlushTime;
+	double maxFrameFlushTime;
+	TagStats tags[TAG_CODE_COUNT];
+
+	WriterStats() { clear(); }
+
+	void clear();
+	double getCompressionRatio() const;	// Output over document size, 0 before anything was written
+	std::string toJSON(TagNameFunction tagName = 0) const;
+};
+
+// ----------------------------------------------------------------------------
+// Measures a section when stats are collected, costs nothing otherwise
+class StatsTimer
+{
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point m_start;
+	bool m_active;
+
+public:
+	explicit StatsTimer(bool active) : m_active(active)
+	{
+		if (m_active)
+		{
+			m_start = Clock::now();
+		}
+	}
+
+	inline bool isActive() const { return m_active; }
+	inline double getElapsed() const
+	{
+		return m_active ? std::chrono::duration<double>(Clock::now() - m_start).count() : 0;
+	}
+};